@@ -0,0 +1,173 @@
+/*
+ * myload.c - A configurable workload for benchmarking your tiny shell
+ *
+ * usage: myload [-Si] [-c <ms>] [-s <ms>] [-m <MB>] [-o <bytes>]
+ *               [-f <fanout>] [-d <depth>] [-x <status>]
+ *
+ * Each process forks <fanout> children that do the same, down to
+ * <depth> levels (so -f 10 -d 3 is 1 + 10 + 100 + 1000 processes), then
+ * touches <MB> MB of memory and keeps it, burns <ms> ms of CPU, writes
+ * <bytes> bytes to stdout in 64-byte lines, sleeps <ms> ms, waits for
+ * its children and exits with <status>. With -S the first process stops
+ * itself with SIGTSTP before it waits; with -i they all ignore SIGINT
+ * and SIGTSTP. Everything is off by default: "myload" alone exits 0 at
+ * once. The output only depends on the arguments.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define OUTBUF 65536 /* bytes written at a time */
+#define LINE 64      /* bytes per output line */
+
+void usage(char *name);
+double cputime_ms(void);
+void writeout(long bytes);
+
+int main(int argc, char **argv)
+{
+    long cpu_ms = 0, sleep_ms = 0, mbytes = 0, bytes = 0, i;
+    int fanout = 0, depth = 1, status = 0, selfstop = 0, c, level;
+    struct timespec ts;
+    char *mem;
+    double start;
+
+    while ((c = getopt(argc, argv, "Sic:s:m:o:f:d:x:")) != EOF) {
+	switch (c) {
+	case 'S':
+	    selfstop = 1;
+	    break;
+	case 'i':
+	    signal(SIGINT, SIG_IGN);
+	    signal(SIGTSTP, SIG_IGN);
+	    break;
+	case 'c':
+	    cpu_ms = atol(optarg);
+	    break;
+	case 's':
+	    sleep_ms = atol(optarg);
+	    break;
+	case 'm':
+	    mbytes = atol(optarg);
+	    break;
+	case 'o':
+	    bytes = atol(optarg);
+	    break;
+	case 'f':
+	    fanout = atoi(optarg);
+	    break;
+	case 'd':
+	    depth = atoi(optarg);
+	    break;
+	case 'x':
+	    status = atoi(optarg);
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (optind != argc || cpu_ms < 0 || sleep_ms < 0 || mbytes < 0 ||
+	bytes < 0 || fanout < 0 || depth < 1)
+	usage(argv[0]);
+
+    /* the tree: a child goes on one level down and forks in turn */
+    for (level = 0; level < depth && fanout > 0; level++) {
+	for (i = 0; i < fanout; i++) {
+	    pid_t pid = fork();
+
+	    if (pid < 0) {
+		fprintf(stderr, "fork error: %s\n", strerror(errno));
+		exit(1);
+	    }
+	    if (pid == 0)
+		break;
+	}
+	if (i == fanout)
+	    break; /* the parent of this level */
+	selfstop = 0;
+    }
+
+    if (mbytes) {
+	if ((mem = malloc(mbytes << 20)) == NULL) {
+	    fprintf(stderr, "malloc error\n");
+	    exit(1);
+	}
+	for (i = 0; i < mbytes << 20; i += 4096)
+	    mem[i] = 1;
+    }
+    if (cpu_ms) {
+	volatile long spin;
+
+	start = cputime_ms();
+	while (cputime_ms() - start < cpu_ms)
+	    for (spin = 0; spin < 10000; spin++)
+		;
+    }
+    if (bytes)
+	writeout(bytes);
+    if (sleep_ms) {
+	ts.tv_sec = sleep_ms / 1000;
+	ts.tv_nsec = (sleep_ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+	    ;
+    }
+    if (selfstop)
+	kill(getpid(), SIGTSTP);
+    while (wait(NULL) > 0)
+	;
+    /*
+     * _exit: the memory is kept on purpose, and the leak check exit()
+     * runs under -fsanitize=address stops the process to scan it, which
+     * a SIGCONT from the shell can cancel, hanging the check.
+     */
+    _exit(status);
+}
+
+/* cputime_ms - CPU time used by this process, in ms */
+double cputime_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*
+ * writeout - Write bytes bytes of LINE-byte lines to stdout. A short
+ *     write (a signal, a stop) goes on where it left off in buf, which
+ *     holds a whole number of lines, so the pattern is never broken.
+ */
+void writeout(long bytes)
+{
+    static char buf[OUTBUF];
+    long i, n, off = 0;
+    ssize_t w;
+
+    for (i = 0; i < OUTBUF; i++)
+	buf[i] = i % LINE == LINE - 1 ? '\n' : 'a' + i % LINE % 26;
+    while (bytes > 0) {
+	n = OUTBUF - off;
+	if (n > bytes)
+	    n = bytes;
+	if ((w = write(STDOUT_FILENO, buf + off, n)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    exit(1); /* e.g. EPIPE: nobody is reading */
+	}
+	bytes -= w;
+	off = (off + w) % OUTBUF;
+    }
+}
+
+void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s [-Si] [-c <ms>] [-s <ms>] [-m <MB>] [-o <bytes>]\n"
+	    "       [-f <fanout>] [-d <depth>] [-x <status>]\n", name);
+    exit(1);
+}
@@ -1,768 +1,5562 @@
-/*
- * tsh - A tiny shell program with job control
- */
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
-#include <ctype.h>
-#include <signal.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <errno.h>
-
-/* Misc manifest constants */
-#define MAXLINE 1024   /* max line size */
-#define MAXARGS 128    /* max args on a command line */
-#define MAXJOBS 16     /* max jobs at any point in time */
-#define MAXJID 1 << 16 /* max job ID */
-
-/* Job states */
-#define UNDEF 0 /* undefined */
-#define FG 1    /* running in foreground */
-#define BG 2    /* running in background */
-#define ST 3    /* stopped */
-
-/*
- * Jobs states: FG (foreground), BG (background), ST (stopped)
- * Job state transitions and enabling actions:
- *     FG -> ST  : ctrl-z
- *     ST -> FG  : fg command
- *     ST -> BG  : bg command
- *     BG -> FG  : fg command
- * At most 1 job can be in the FG state.
- */
-
-/* Global variables */
-extern char **environ;   /* defined in libc */
-char prompt[] = "tsh> "; /* command line prompt (DO NOT CHANGE) */
-int verbose = 0;         /* if true, print additional output */
-int nextjid = 1;         /* next job ID to allocate */
-char sbuf[MAXLINE];      /* for composing sprintf messages */
-
-struct job_t
-{                          /* The job struct */
-    pid_t pid;             /* job PID */
-    int jid;               /* job ID [1, 2, ...] */
-    int state;             /* UNDEF, BG, FG, or ST */
-    char cmdline[MAXLINE]; /* command line */
-};
-struct job_t jobs[MAXJOBS]; /* The job list */
-/* End global variables */
-
-/* Function prototypes */
-
-/* Here are the functions that you will implement */
-void eval(char *cmdline);
-int builtin_cmd(char **argv);
-void do_bgfgkl(char **argv);
-void do_export(char **argv);
-void waitfg(pid_t pid);
-
-void sigchld_handler(int sig);
-void sigtstp_handler(int sig);
-void sigint_handler(int sig);
-
-/* Here are helper routines that we've provided for you */
-int parseline(const char *cmdline, char **argv);
-void sigquit_handler(int sig);
-
-void clearjob(struct job_t *job);
-void initjobs(struct job_t *jobs);
-int maxjid(struct job_t *jobs);
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
-int deletejob(struct job_t *jobs, pid_t pid);
-pid_t fgpid(struct job_t *jobs);
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
-struct job_t *getjobjid(struct job_t *jobs, int jid);
-int pid2jid(pid_t pid);
-void listjobs(struct job_t *jobs);
-
-void usage(void);
-void unix_error(char *msg);
-void app_error(char *msg);
-typedef void handler_t(int);
-handler_t *Signal(int signum, handler_t *handler);
-
-/*
- * main - The shell's main routine
- */
-int main(int argc, char **argv)
-{
-    char c;
-    char cmdline[MAXLINE];
-    int emit_prompt = 1; /* emit prompt (default) */
-
-    /* Redirect stderr to stdout (so that driver will get all output
-     * on the pipe connected to stdout) */
-    dup2(1, 2);
-
-    /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF)
-    {
-        switch (c)
-        {
-        case 'h': /* print help message */
-            usage();
-            break;
-        case 'v': /* emit additional diagnostic info */
-            verbose = 1;
-            break;
-        case 'p':            /* don't print a prompt */
-            emit_prompt = 0; /* handy for automatic testing */
-            break;
-        default:
-            usage();
-        }
-    }
-
-    /* Install the signal handlers */
-
-    /* These are the ones you will need to implement */
-    Signal(SIGINT, sigint_handler);   /* ctrl-c */
-    Signal(SIGTSTP, sigtstp_handler); /* ctrl-z */
-    Signal(SIGCHLD, sigchld_handler); /* Terminated or stopped child */
-
-    /* This one provides a clean way to kill the shell */
-    Signal(SIGQUIT, sigquit_handler);
-
-    /* Initialize the job list */
-    initjobs(jobs);
-
-    /* Execute the shell's read/eval loop */
-    while (1)
-    {
-        /* Read command line */
-        if (emit_prompt)
-        {
-            printf("%s", prompt);
-            fflush(stdout);
-        }
-        if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-            app_error("fgets error");
-        if (feof(stdin))
-        { /* End of file (ctrl-d) */
-            fflush(stdout);
-            exit(0);
-        }
-
-        /* Evaluate the command line */
-        eval(cmdline);
-        fflush(stdout);
-        fflush(stdout);
-    }
-
-    exit(0); /* control never reaches here */
-}
-
-/*
- * eval - Evaluate the command line that the user has just typed in
- *
- * If the user has requested a built-in command (quit, jobs, bg or fg)
- * then execute it immediately. Otherwise, fork a child process and
- * run the job in the context of the child. If the job is running in
- * the foreground, wait for it to terminate and then return.  Note:
- * each child process must have a unique process group ID so that our
- * background children don't receive SIGINT (SIGTSTP) from the kernel
- * when we type ctrl-c (ctrl-z) at the keyboard.
- */
-void eval(char *cmdline)
-{
-    char *argv[MAXARGS];
-    char buf[MAXLINE];
-    int bg;
-    pid_t pid;
-
-    sigset_t mask_single, mask_every, mask_prev;
-    sigemptyset(&mask_single);
-    sigfillset(&mask_every);
-    sigaddset(&mask_single, SIGCHLD); /*ADD SIGCHLD TO THE CUSTOM MASK*/
-
-    strcpy(buf, cmdline);
-    bg = parseline(buf, argv);
-    if (argv[0] == NULL)
-    {
-        return;
-    }
-    if (!builtin_cmd(argv))
-    {
-        sigprocmask(SIG_BLOCK, &mask_single, &mask_prev);
-        if ((pid = fork()) == 0)
-        {
-            setpgid(0, 0);
-            sigprocmask(SIG_SETMASK, &mask_prev, NULL);
-            if (execve(argv[0], argv, environ) < 0)
-            {
-                printf("%s: Command not found\n", argv[0]);
-                deletejob(jobs, getpgid(pid));
-                exit(0);
-            }
-        }
-        if (!bg)
-        {
-            sigprocmask(SIG_BLOCK, &mask_every, NULL); /*make sure that job is added to the list before it's deleted*/
-            addjob(jobs, pid, FG, cmdline);
-            sigprocmask(SIG_SETMASK, &mask_prev, NULL); /*unblock the signals*/
-            waitfg(pid);                                /*wait until foreground process terminates or receives interrupt*/
-        }
-        else
-        {
-            sigprocmask(SIG_BLOCK, &mask_every, NULL);
-            addjob(jobs, pid, BG, cmdline);
-            sigprocmask(SIG_SETMASK, &mask_prev, NULL);
-            printf("[%d] (%d) %s", pid2jid(pid), pid, cmdline);
-        }
-    }
-    return;
-}
-
-/*
- * parseline - Parse the command line and build the argv array.
- *
- * Characters enclosed in single quotes are treated as a single
- * argument.  Return true if the user has requested a BG job, false if
- * the user has requested a FG job.
- */
-int parseline(const char *cmdline, char **argv)
-{
-    static char array[MAXLINE]; /* holds local copy of command line */
-    char *buf = array;          /* ptr that traverses command line */
-    char *delim;                /* points to first space delimiter */
-    int argc;                   /* number of args */
-    int bg;                     /* background job? */
-
-    strcpy(buf, cmdline);
-    buf[strlen(buf) - 1] = ' ';   /* replace trailing '\n' with space */
-    while (*buf && (*buf == ' ')) /* ignore leading spaces */
-        buf++;
-
-    /* Build the argv list */
-    argc = 0;
-    if (*buf == '\'')
-    {
-        buf++;
-        delim = strchr(buf, '\'');
-    }
-    else
-    {
-        delim = strchr(buf, ' ');
-    }
-
-    while (delim)
-    {
-        if (*buf == '$')
-        {
-            buf++;
-            static char arr[100];
-            char *ptr = arr;
-            strcpy(ptr, buf);       /*copy to temporary var*/
-            ptr = strtok(ptr, " "); /*remove empty spaces*/
-            if (getenv(ptr))
-            { /*check if registered env variable*/
-                buf = strtok(buf, " ");
-                buf = getenv(buf); /* if valid replace the variable name with its value*/
-            }
-            else
-            {
-                buf += (strlen(ptr) + 1); /*else check next one*/
-                argv[argc] = buf;
-            }
-        }
-        else
-        {
-            argv[argc++] = buf;
-            *delim = '\0';
-            buf = delim + 1;
-            while (*buf && (*buf == ' ')) /* ignore spaces */
-                buf++;
-            if (*buf == '\'')
-            {
-                buf++;
-                delim = strchr(buf, '\'');
-            }
-            else
-            {
-                delim = strchr(buf, ' ');
-            }
-        }
-    }
-
-    argv[argc] = NULL;
-
-    if (argc == 0) /* ignore blank line */
-        return 1;
-
-    /* should the job run in the background? */
-    if ((bg = (*argv[argc - 1] == '&')) != 0)
-    {
-        argv[--argc] = NULL;
-    }
-    return bg;
-}
-
-/*
- * builtin_cmd - If the user has typed a built-in command then execute
- *    it immediately.
- */
-int builtin_cmd(char **argv)
-{
-    if (!strcmp(argv[0], "quit"))
-    {
-        exit(0);
-    }
-    if (!strcmp(argv[0], "jobs"))
-    {
-        listjobs(jobs);
-        return 1;
-    }
-    if (!strcmp(argv[0], "bg") || !strcmp(argv[0], "fg") || !strcmp(argv[0], "kill"))
-    {
-        do_bgfgkl(argv);
-        return 1;
-    }
-    if (!strcmp(argv[0], "export"))
-    {
-        do_export(argv);
-        return 1;
-    }
-    return 0; /* not a builtin command */
-}
-
-/*
- * do_bgfgkl - Execute the builtin bg, fg and kill commands
- */
-void do_bgfgkl(char **argv)
-{
-    if (!strcmp(argv[0], "bg"))
-    {
-        if (!argv[1])
-        {
-            printf("bg command requires PID or %%jobid argument\n");
-        }
-        else if (!(atoi(argv[1] + 1)))
-        {
-            printf("bg: argument must be a PID or %%jobid\n");
-        }
-        else if (argv[1][0] != '%')
-        {
-            printf("(%s): No such process\n", argv[1]);
-        }
-        else
-        {
-            struct job_t *ptr = getjobjid(jobs, atoi(++argv[1]));
-            if (ptr != NULL)
-            { /*Check if the jobid exists*/
-
-                pid_t pid = ptr->pid;
-                int jid = ptr->jid;
-                char *cmdline = ptr->cmdline;
-                ptr->state = BG;    /*Set the state of the process to bg*/
-                kill(pid, SIGCONT); /*Send signal to continue*/
-
-                printf("[%d] (%d) %s", jid, pid, cmdline);
-            }
-            else
-            {
-                printf("%%%s: No such job\n", argv[1]);
-            }
-        }
-    }
-    else if (!strcmp(argv[0], "fg"))
-    {
-        if (!argv[1])
-        {
-            printf("fg command requires PID or %%jobid argument\n");
-        }
-        else if (!(atoi(argv[1] + 1)))
-        {
-            printf("fg: argument must be a PID or %%jobid\n");
-        }
-        else if (argv[1][0] != '%')
-        {
-            printf("(%s): No such process\n", argv[1]);
-        }
-        else
-        {
-            struct job_t *ptr = getjobjid(jobs, atoi(++argv[1]));
-            if (ptr != NULL)
-            {
-
-                pid_t pid = ptr->pid;
-                killpg(pid, SIGCONT);
-                ptr->state = FG;
-                waitfg(pid);
-            }
-            else
-            {
-                printf("%%%s: No such job\n", argv[1]);
-            }
-        }
-    }
-    else
-    {
-        struct job_t *ptr = getjobjid(jobs, atoi(++argv[1]));
-        if (ptr != NULL)
-        {
-
-            pid_t pid = ptr->pid;
-            kill(pid, SIGKILL);
-            deletejob(jobs, pid);
-        }
-        else
-        {
-            printf("%s: No such job\n", argv[1]);
-        }
-    }
-
-    return;
-}
-
-/*
- * do_export - Execute the builtin export commands
- */
-
-void do_export(char **argv)
-{
-
-    char *ptr1, *ptr2;  /*To export the environment prepare 2 string args*/
-    char hold_env[100]; /*prepare character buffer array to copy argv*/
-    strcpy(hold_env, argv[1]);
-    ptr1 = strtok(hold_env, "="); /*tokenize the string into 2 arguments using '=' */
-    ptr2 = strtok(NULL, "=");
-    setenv(ptr1, ptr2, 1); /*export the environment variable with its value*/
-    return;
-}
-
-/*
- * waitfg - Block until process pid is no longer the foreground process
- */
-void waitfg(pid_t pid)
-{
-    struct job_t *ptr = getjobpid(jobs, pid); /*sleep until the state of the FG process changes*/
-    while ((ptr->state == FG) && ptr != NULL)
-    { /*check everytime whether the state has changed and is unterminated*/
-        sleep(1);
-    }
-    return;
-}
-
-/*****************
- * Signal handlers
- *****************/
-
-/*
- * sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
- *     a child job terminates (becomes a zombie), or stops because it
- *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
- *     available zombie children, but doesn't wait for any other
- *     currently running children to terminate.
- */
-void sigchld_handler(int sig)
-{
-    int status;
-    pid_t pid;
-    if ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) < 0)
-    {
-        unix_error("pid_error");
-    }
-    else
-    {
-        if (pid)
-        { /*if nonzero pid is returned*/
-            if (WIFEXITED(status))
-            {
-                deletejob(jobs, pid);
-            }
-            else if (WIFSIGNALED(status))
-            {
-                if (WTERMSIG(status) == 2)
-                {
-                    printf("Job [%d] (%d) terminated by signal 2\n", pid2jid(pid), pid);
-                    deletejob(jobs, pid);
-                }
-            }
-            else
-            {
-                if (WIFSTOPPED(status))
-                {
-                    struct job_t *ptr = getjobpid(jobs, pid);
-                    ptr->state = ST;
-                    printf("Job [%d] (%d) stopped by signal 20\n", pid2jid(pid), pid);
-                }
-            }
-        }
-        else
-        {
-            return;
-        }
-    }
-}
-
-/*
- * sigint_handler - The kernel sends a SIGINT to the shell whenver the
- *    user types ctrl-c at the keyboard.  Catch it and send it along
- *    to the foreground job.
- */
-void sigint_handler(int sig)
-{
-    pid_t pid = fgpid(jobs);
-    pid = getpgid(pid);
-
-    if (pid)
-    {
-        killpg(pid, sig);
-    }
-    return;
-}
-
-/*
- * sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
- *     the user types ctrl-z at the keyboard. Catch it and suspend the
- *     foreground job by sending it a SIGTSTP.
- */
-void sigtstp_handler(int sig)
-{
-    pid_t pid = fgpid(jobs);
-    if (pid)
-    {
-        killpg(pid, sig);
-    }
-    return;
-}
-
-/*********************
- * End signal handlers
- *********************/
-
-/***********************************************
- * Helper routines that manipulate the job list
- **********************************************/
-
-/* clearjob - Clear the entries in a job struct */
-void clearjob(struct job_t *job)
-{
-    job->pid = 0;
-    job->jid = 0;
-    job->state = UNDEF;
-    job->cmdline[0] = '\0';
-}
-
-/* initjobs - Initialize the job list */
-void initjobs(struct job_t *jobs)
-{
-    int i;
-
-    for (i = 0; i < MAXJOBS; i++)
-        clearjob(&jobs[i]);
-}
-
-/* maxjid - Returns largest allocated job ID */
-int maxjid(struct job_t *jobs)
-{
-    int i, max = 0;
-
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].jid > max)
-            max = jobs[i].jid;
-
-    return max;
-}
-
-/* addjob - Add a job to the job list */
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline)
-{
-    int i;
-
-    if (pid < 1)
-        return 0;
-
-    for (i = 0; i < MAXJOBS; i++)
-    {
-        if (jobs[i].pid == 0)
-        {
-            jobs[i].pid = pid;
-            jobs[i].state = state;
-            jobs[i].jid = nextjid++;
-            if (nextjid > MAXJOBS)
-                nextjid = 1;
-            strcpy(jobs[i].cmdline, cmdline);
-            if (verbose)
-            {
-                printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, jobs[i].cmdline);
-            }
-            return 1;
-        }
-    }
-    printf("Tried to create too many jobs\n");
-    return 0;
-}
-
-/* deletejob - Delete a job whose PID=pid from the job list */
-int deletejob(struct job_t *jobs, pid_t pid)
-{
-    int i;
-
-    if (pid < 1)
-        return 0;
-
-    for (i = 0; i < MAXJOBS; i++)
-    {
-        if (jobs[i].pid == pid)
-        {
-            clearjob(&jobs[i]);
-            nextjid = maxjid(jobs) + 1;
-            return 1;
-        }
-    }
-    return 0;
-}
-
-/* fgpid - Return PID of current foreground job, 0 if no such job */
-pid_t fgpid(struct job_t *jobs)
-{
-    int i;
-
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].state == FG)
-            return jobs[i].pid;
-
-    return 0;
-}
-
-/* getjobpid  - Find a job (by PID) on the job list */
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid)
-{
-    int i;
-
-    if (pid < 1)
-        return NULL;
-
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].pid == pid)
-            return &jobs[i];
-
-    return NULL;
-}
-
-/* getjobjid  - Find a job (by JID) on the job list */
-struct job_t *getjobjid(struct job_t *jobs, int jid)
-{
-    int i;
-
-    if (jid < 1)
-        return NULL;
-
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].jid == jid)
-            return &jobs[i];
-
-    return NULL;
-}
-
-/* pid2jid - Map process ID to job ID */
-int pid2jid(pid_t pid)
-{
-    int i;
-
-    if (pid < 1)
-        return 0;
-
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].pid == pid)
-            return jobs[i].jid;
-
-    return 0;
-}
-
-/* listjobs - Print the job list */
-void listjobs(struct job_t *jobs)
-{
-    int i;
-
-    for (i = 0; i < MAXJOBS; i++)
-    {
-        if (jobs[i].pid != 0)
-        {
-            printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-            switch (jobs[i].state)
-            {
-            case BG:
-                printf("Running ");
-                break;
-            case FG:
-                printf("Foreground ");
-                break;
-            case ST:
-                printf("Stopped ");
-                break;
-            default:
-                printf("listjobs: Internal error: job[%d].state=%d ",
-                       i, jobs[i].state);
-            }
-            printf("%s", jobs[i].cmdline);
-        }
-    }
-}
-/******************************
- * end job list helper routines
- ******************************/
-
-/***********************
- * Other helper routines
- ***********************/
-
-/*
- * usage - print a help message
- */
-void usage(void)
-{
-    printf("Usage: shell [-hvp]\n");
-    printf("   -h   print this message\n");
-    printf("   -v   print additional diagnostic information\n");
-    printf("   -p   do not emit a command prompt\n");
-    exit(1);
-}
-
-/*
- * unix_error - unix-style error routine
- */
-void unix_error(char *msg)
-{
-    fprintf(stdout, "%s: %s\n", msg, strerror(errno));
-    exit(1);
-}
-
-/*
- * app_error - application-style error routine
- */
-void app_error(char *msg)
-{
-    fprintf(stdout, "%s\n", msg);
-    exit(1);
-}
-
-/*
- * Signal - wrapper for the sigaction function
- */
-handler_t *Signal(int signum, handler_t *handler)
-{
-    struct sigaction action, old_action;
-
-    action.sa_handler = handler;
-    sigemptyset(&action.sa_mask); /* block sigs of type being handled */
-    action.sa_flags = SA_RESTART; /* restart syscalls if possible */
-
-    if (sigaction(signum, &action, &old_action) < 0)
-        unix_error("Signal error");
-    return (old_action.sa_handler);
-}
-
-/*
- * sigquit_handler - The driver program can gracefully terminate the
- *    child shell by sending it a SIGQUIT signal.
- */
-void sigquit_handler(int sig)
-{
-    printf("Terminating after receipt of SIGQUIT signal\n");
-    exit(1);
-}
+/*
+ * tsh - A tiny shell program with job control
+ */
+#define _GNU_SOURCE /* for pipe2, splice and copy_file_range */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/pidfd.h>
+#include <sys/time.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> /* for __rdtsc */
+#endif
+
+#include "tshtrace.h"
+
+/* Misc manifest constants */
+#define MAXLINE 1024   /* max line size */
+#define ARENAMIN 4096  /* smallest line arena block */
+#define ARENAALIGN 16  /* alignment of line arena allocations */
+#define ARGVMIN 64     /* initial argv slots */
+#define MAXJOBS 16       /* initial job list capacity */
+#define MAXJID (1 << 16) /* max job ID */
+#define REAPBATCH 64     /* children collected per waitpid sweep */
+#define JOBCHUNK 64      /* job records allocated at a time */
+#define POOLBLOCK 65536  /* string pool allocation unit */
+#define POOLMIN 16       /* smallest string pool cell */
+#define POOLCLASSES 32   /* string pool size classes */
+#define HASHCAP 64       /* initial command hash capacity */
+#define ENVCAP 64        /* initial environment hash capacity */
+#define COPYCHUNK (1 << 24) /* bytes asked of the kernel per copy call */
+#define COPYBUF 65536    /* buffer for copies the kernel can't do */
+#define READBLOCK 65536  /* input read at a time when it can't be mapped */
+#define OUTBUF 65536     /* stdout buffer when it isn't a terminal */
+#define SIGBATCH 16      /* signals read from the signalfd at a time */
+#define RESCAN 10        /* jtop samples between searches for new processes */
+#define ZYGOTESTACK (256 * 1024) /* stack of a child of the zygote */
+#define TRACECAP 65536   /* events kept by the trace ring (a power of 2) */
+#define TRACECAL 10000000 /* ns the trace clock is calibrated over, at least */
+#define CAPTURETAG (1ULL << 63) /* epoll data of a capture pipe: tag | JID */
+
+/* Where spread puts background jobs */
+#define SPREAD_OFF 0  /* nowhere: they get the shell's affinity */
+#define SPREAD_CPU 1  /* on the least loaded CPU */
+#define SPREAD_NODE 2 /* on the CPUs of the least loaded NUMA node */
+
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1UL << 2) /* Linux 6.9 */
+#endif
+
+/* Job states */
+#define UNDEF 0 /* undefined */
+#define FG 1    /* running in foreground */
+#define BG 2    /* running in background */
+#define ST 3    /* stopped */
+#define PD 4    /* waiting for the jobs it runs after */
+
+/* What became of a job that is gone, for after */
+#define FATE_NONE 0   /* nothing is known about the JID */
+#define FATE_OK 1     /* its last stage exited with status 0 */
+#define FATE_FAILED 2 /* anything else: a failure, a signal, kill */
+
+/*
+ * Jobs states: FG (foreground), BG (background), ST (stopped),
+ * PD (pending)
+ * Job state transitions and enabling actions:
+ *     FG -> ST  : ctrl-z
+ *     ST -> FG  : fg command
+ *     ST -> BG  : bg command
+ *     BG -> FG  : fg command
+ *     PD -> BG  : the last job it runs after succeeded
+ * At most 1 job can be in the FG state.
+ */
+
+/* Global variables */
+extern char **environ;   /* defined in libc */
+char prompt[] = "tsh> "; /* command line prompt (DO NOT CHANGE) */
+int verbose = 0;         /* if true, print additional output */
+int use_spawn = 0;       /* if true, launch jobs with posix_spawn */
+int use_zygote = 0;      /* if true, launch jobs through the zygote */
+int use_external = 0;    /* if true, run echo, printf, ... as programs */
+int announce = 1;        /* if false, background jobs start silently */
+int use_capture = 0;     /* if true, capture the output of background jobs */
+int builtin_status = 0;  /* exit status of the last builtin that ran */
+char sbuf[MAXLINE];      /* for composing sprintf messages */
+
+/*
+ * What a job has used, for jobs -l and time. The times come from the
+ * monotonic clock, taken once around each launch and once per batch of
+ * reaped children; the rest is the rusage the kernel hands back with
+ * each exit status, summed over the stages (the RSS is the largest).
+ */
+struct jobstats_t
+{
+    struct timespec forked;      /* its first stage was about to be started */
+    struct timespec execd;       /* and was started: after the exec with -s,
+                                  * after the fork (the child execs next)
+                                  * without */
+    struct timespec exited;      /* its last stage was reaped */
+    struct timeval utime, stime; /* CPU time of the reaped stages */
+    long maxrss;                 /* largest max RSS of a stage, in KB */
+    long nvcsw, nivcsw;          /* voluntary and involuntary switches */
+};
+
+/*
+ * With capture on (-o, or "capture on"), the stdout and stderr of a
+ * background job go to a pipe instead of the terminal, and the event
+ * loop drains the pipe, with non-blocking reads straight into a ring of
+ * the job's last CAPTURECAP bytes; jobs -o shows them. The job never
+ * waits for a slow terminal, and however much it prints, it costs the
+ * shell one ring, made when its first byte comes. While the job is in
+ * the foreground, what it prints is passed on to our stdout as well.
+ */
+struct capture_t
+{
+    int fd;         /* our end of the pipe, -1 once it is at its end */
+    int gone;       /* the job is gone; jobs -o -f frees the ring */
+    uint64_t total; /* bytes read; the ring holds the last of them */
+    char *ring;     /* CAPTURECAP bytes, NULL until the first one */
+};
+struct capture_t *followed; /* the ring jobs -o -f is showing, or NULL */
+
+struct job_t
+{                       /* The job struct */
+    pid_t pid;          /* job PID (its first process, the group leader) */
+    int jid;            /* job ID [1, 2, ...] */
+    int state;          /* UNDEF, BG, FG, or ST */
+    int nprocs;         /* number of pipeline stages */
+    int live;           /* stages not yet reaped */
+    int termsig;        /* signal that killed the last stage, or 0 */
+    int status;         /* wait status of the last stage, -1 until reaped */
+    pid_t *pids;        /* PIDs of the stages, &pid for a single one */
+    int pidfd;          /* the leader's pidfd until it is reaped, or -1 */
+    int place;          /* where spread put it, or -1 */
+    int *after;         /* PD: JIDs it runs after, 0 once they are done */
+    int nafter;         /* size of after */
+    int waiting;        /* how many of them haven't finished */
+    char *words;        /* PD: its command's words, each with its '\0' */
+    size_t wordslen;    /* size of words */
+    char *cmdline;      /* command line, kept in the string pool */
+    struct capture_t *out; /* its captured output, or NULL */
+    struct jobstats_t stats; /* resource use */
+    struct job_t *next; /* free list link */
+};
+
+/*
+ * The string pool holds the job command lines and the stage PIDs of
+ * pipeline jobs. They live in cells of power-of-two size classes carved
+ * out of POOLBLOCK blocks; a freed cell goes on the free list of its
+ * class (the link is stored in the cell), so releasing one never calls
+ * free() and is safe from a signal handler. Cells are only carved in
+ * ordinary context.
+ */
+struct strpool_t
+{
+    char *free[POOLCLASSES]; /* free cells by size class */
+    char *block;             /* unused tail of the current block */
+    size_t left;             /* bytes left at block */
+};
+struct strpool_t strpool; /* The command line pool */
+
+struct cmdhash_t
+{               /* A remembered command location */
+    char *name; /* command name as typed, NULL if the slot is empty */
+    char *path; /* where it was found */
+    int dir;    /* index of its directory in $PATH */
+    int hits;   /* number of times it was run */
+};
+
+/*
+ * The command hash maps command names to where they were found on
+ * $PATH, like bash's hash, so a command is searched for once instead of
+ * on every run. It is flushed when PATH is exported or when the mtime
+ * of a PATH directory changes: the directory of a hit is checked every
+ * time, and all of them at most once a second, so a new command that
+ * shadows a remembered one is seen within a second.
+ */
+struct cmdcache_t
+{
+    struct cmdhash_t *tab;  /* open-addressed by name */
+    int cap;                /* slots in tab (power of 2) */
+    int count;              /* remembered commands */
+    char *path;             /* copy of $PATH that dirs point into */
+    char **dirs;            /* $PATH split at ':' */
+    struct timespec *mtime; /* mtime of each dir when last checked */
+    int ndirs;              /* number of dirs */
+    time_t checked;         /* when all dirs were last checked */
+};
+struct cmdcache_t cmdcache; /* The command hash */
+
+struct envvar_t
+{                   /* An environment variable */
+    char *entry;    /* "NAME=value" in the string pool, NULL if the slot is empty */
+    size_t namelen; /* length of NAME */
+    int envidx;     /* its slot in envp */
+};
+
+/*
+ * The environment belongs to the shell: variables are kept in an
+ * open-addressed hash by name, so $VAR and export take one lookup
+ * however big the environment is. The envp array that children get is
+ * kept current as variables are set: a new value takes the old one's
+ * slot before the old entry goes back to the pool, so envp (and libc's
+ * environ, which points at it) never holds a freed entry.
+ */
+struct envtab_t
+{
+    struct envvar_t *tab; /* open-addressed by NAME */
+    int cap;              /* slots in tab (power of 2) */
+    int count;            /* variables */
+    char **envp;          /* the entries for execve, NULL terminated */
+    int envcap;           /* slots in envp */
+};
+struct envtab_t shellenv; /* The environment */
+
+struct pident_t
+{               /* A PID hash entry */
+    pid_t pid;  /* PID of one stage of a job */
+    int jid;    /* its job, 0 = empty slot */
+};
+
+/*
+ * The job list. Jobs are indexed directly by JID and through an
+ * open-addressed hash by PID, so lookups don't depend on the number of
+ * jobs. Every stage of a pipeline has its own PID hash entry, which is
+ * removed when that stage is reaped. The tables only grow in addjob();
+ * sigchld_handler only deletes, which never allocates, and returns
+ * records to a free list for addjob() to reuse. Neither runs in a real
+ * signal handler any more (see the event loop).
+ *
+ * A job started with "after %1 %2 -- cmd" is on the list from the start,
+ * pending, with a JID but no processes, until the jobs it runs after
+ * are gone. As each one goes, removejob() checks off the pending jobs
+ * waiting for it: if it failed, they are dropped too (and so on down the
+ * graph); once all of them have succeeded, runready() starts the job
+ * from the event loop. Cycles can't be made, as a job may only wait for
+ * jobs that came before it.
+ */
+struct joblist_t
+{
+    struct job_t **byjid;    /* byjid[jid] is the job with that JID */
+    int jidcap;              /* number of slots in byjid */
+    int maxjid;              /* largest allocated job ID */
+    struct pident_t *bypid;  /* PID hash of the stages of all jobs */
+    int pidcap;              /* number of slots in bypid (power of 2) */
+    int nprocs;              /* number of entries in bypid */
+    int count;               /* number of jobs */
+    struct job_t *fg;        /* cached foreground job */
+    struct job_t *free;      /* recycled job records */
+    struct jobstats_t last;  /* use of the last job to finish, for time */
+    pid_t lastpid;           /* and its PID */
+    unsigned gen;            /* bumped whenever a job or a stage goes */
+    char *fate;              /* fate[jid]: how the last job with it ended */
+    int maxfate;             /* no JID above it has a fate */
+    int ready;               /* pending jobs whose wait is over */
+};
+struct joblist_t jobs; /* The job list */
+
+/*
+ * The line arena holds everything parsed from the command line being
+ * run: a copy of the line that the words are cut out of, the argv
+ * array and the per-stage tables of eval(). It is a bump allocator over
+ * a chain of blocks, so nothing moves while a line is parsed; a reset
+ * keeps a single block big enough for the largest line so far.
+ */
+struct arena_t
+{
+    char *block;  /* current block; its first word links to the previous */
+    size_t used;  /* bytes used in block */
+    size_t cap;   /* size of block */
+    size_t total; /* bytes handed out since the last reset */
+};
+struct arena_t linearena; /* The line arena */
+
+struct words_t
+{                /* A command line cut into words */
+    char **argv; /* the words, NULL terminated */
+    int argc;    /* number of words */
+};
+
+struct redir_t
+{                 /* The I/O redirections of a pipeline stage */
+    char *in;     /* < file, or NULL */
+    char *out;    /* > file or >> file, or NULL */
+    int append;   /* out was given with >> */
+    int errout;   /* 2>&1: stderr goes where stdout goes */
+    int fd[2];    /* in and out once opened, -1 if not */
+};
+
+/*
+ * The line reader feeds the read/eval loop. A script file (or stdin if
+ * it is a regular file) is mapped and a -c string is used as it is, so
+ * running them reads nothing; other input is read READBLOCK bytes at a
+ * time. Each line is handed out NUL terminated, with its newline, in a
+ * buffer that is reused for the next one.
+ */
+struct reader_t
+{
+    int fd;         /* input, -1 once all of it is in buf */
+    char *buf;      /* the mapping, the -c string or the read buffer */
+    size_t len;     /* bytes in buf */
+    size_t pos;     /* start of the next line in buf */
+    size_t cap;     /* size of the read buffer, 0 if buf isn't one */
+    char *line;     /* the line handed out */
+    size_t linecap; /* size of line */
+    dev_t dev;      /* the file read, to tell it from others */
+    ino_t ino;
+};
+struct reader_t input; /* The shell's input */
+
+/*
+ * The event loop. SIGCHLD, SIGINT, SIGTSTP and SIGQUIT are kept blocked
+ * and read from a signalfd, so their "handlers" are ordinary functions
+ * called from here: while the shell waits for its foreground job or for
+ * input, never in the middle of a change to the job list or a printf.
+ * One epoll set watches the signalfd, the input and a pidfd for each
+ * child, so a child that exits is reaped on its own with waitid(), at a
+ * cost that doesn't depend on how many other children there are, and
+ * can't be mistaken for a process that later gets its PID. SIGCHLD is
+ * then only needed for stops. Each event carries the fd, and for a
+ * child its PID in the upper half. The input is only watched while we
+ * want to read it, or a line typed ahead would keep waking up waitfg().
+ */
+struct evloop_t
+{
+    int epfd;      /* the epoll set */
+    int sigfd;     /* signalfd for the signals in mask */
+    int infd;      /* input fd in the set, -1 if it can't be polled */
+    int armed;     /* infd is being watched */
+    int pidfds;    /* children are watched through pidfds */
+    int timerfd;   /* periodic timer, -1 until settimer() makes it */
+    int expired;   /* timer ticks since the caller last looked */
+    int intr;      /* a SIGINT came since the caller last looked */
+    sigset_t mask; /* the signals read from sigfd */
+};
+struct evloop_t loop;  /* The event loop */
+sigset_t shellmask;    /* signal mask the shell started with, for children */
+
+/*
+ * The sampler behind jtop. It keeps /proc/<pid>/stat and statm open for
+ * every process in the jobs' process groups (the stages and whatever
+ * they started, found through /proc/<pid>/task/<pid>/children), so a
+ * sample costs two preads per process. The list is rebuilt only when
+ * the job list has changed or a process has gone, and every RESCAN
+ * samples to pick up new descendants; a rebuild keeps the fds of the
+ * processes it already had. It is sorted by PID.
+ */
+struct procstat_t
+{
+    pid_t pid;                /* a process of a job */
+    int jid;                  /* its job */
+    int statfd, statmfd;      /* its /proc/<pid>/stat and statm */
+    unsigned long long ticks; /* utime + stime at the last sample */
+    long rss;                 /* resident pages at the last sample */
+    unsigned long long dticks; /* ticks since the sample before */
+    long drss;                 /* change of rss since then */
+    int fresh;                 /* not sampled yet */
+};
+struct sampler_t
+{
+    struct procstat_t *procs; /* the processes, by PID */
+    int n, cap;               /* count and slots */
+    unsigned gen;             /* jobs.gen at the last rebuild */
+    int stale;                /* a process has gone since then */
+    int samples;              /* samples since then */
+    struct timespec at;       /* time of the last sample */
+};
+struct sampler_t sampler; /* jtop's sampler */
+
+/*
+ * Spreading background jobs over the machine. The places are the online
+ * CPUs, or the NUMA nodes (as their CPUs; memory follows the CPU it is
+ * first touched from). Each counts the jobs spread to it that are still
+ * on the job list, and a new job goes to the place with the fewest,
+ * lowest numbered first. The shell only knows about its own jobs, which
+ * is the point: without this they all inherit the shell's affinity.
+ */
+struct spread_t
+{
+    int mode;        /* SPREAD_OFF, SPREAD_CPU or SPREAD_NODE */
+    int nplaces;     /* number of places */
+    int *load;       /* jobs spread to each place */
+    int *id;         /* the CPU or node number of each place */
+    cpu_set_t *sets; /* the CPUs of each place */
+};
+struct spread_t spread; /* background job placement */
+
+/*
+ * With -z, jobs are started by a zygote: a copy of the shell forked
+ * before it has built anything, which waits on one end of a socketpair
+ * for launch requests. A request is this header, with the stdin, stdout
+ * and stderr of the child (those that aren't inherited) attached as
+ * SCM_RIGHTS, followed by len bytes: the program's path, then argc
+ * argument and envc environment strings, each with its '\0'. The zygote
+ * answers with the PID of the child, or -errno if it couldn't clone one.
+ * If the zygote dies, the shell notices its end of the socket close,
+ * reaps it and forks from then on: a new zygote would be forked from
+ * the shell as it is now, holding the epoll set, the capture pipes and
+ * everything else it has open.
+ */
+struct zyreq_t
+{
+    size_t len;      /* bytes of strings after the header */
+    int argc, envc;  /* argument and environment strings among them */
+    pid_t pgid;      /* process group to join, 0 for a new one */
+    int io[3];       /* index of the passed fd for stdin/out/err, or -1 */
+    int pinned;      /* cpus holds the CPUs to run on */
+    sigset_t mask;   /* signal mask of the child */
+    cpu_set_t cpus;
+};
+struct zychild_t
+{ /* what a child of the zygote needs to exec */
+    struct zyreq_t *req;
+    char *path;
+    char **argv, **envp;
+    int *fds, nfds; /* the passed fds */
+};
+int zygotefd = -1;    /* our end of the zygote's socketpair, with -z */
+pid_t zygotepid = -1; /* the zygote */
+
+/*
+ * The lifecycle trace. Each event is a timestamp, a type and the process
+ * and job it is about; the ring keeps the last TRACECAP of them. It is
+ * shared memory mapped before the zygote is forked, so a child can add
+ * the event of its own exec, between fork (or clone) and execve. Adding
+ * one takes no lock and calls nothing that isn't safe in a signal
+ * handler: a writer claims a slot by bumping head, clears the slot's
+ * seq, fills it in and then sets seq to its number + 1. A reader takes
+ * a slot only if seq has that value before and after it copies it, so
+ * it skips slots that are being written or were overwritten. On x86 the
+ * timestamps are TSC ticks, calibrated against CLOCK_MONOTONIC when the
+ * trace is dumped; elsewhere they are CLOCK_MONOTONIC nanoseconds. The
+ * events (struct trevent_t and the TR_* types) are in tshtrace.h, which
+ * tshbench reads the binary dump with.
+ */
+struct tracering_t
+{
+    uint64_t head;  /* events ever claimed */
+    int on;         /* events are being recorded */
+    pid_t shell;    /* our PID */
+    uint64_t t0;    /* tracetime() when the ring was made */
+    uint64_t ns0;   /* and CLOCK_MONOTONIC then, in ns */
+    struct trevent_t ev[TRACECAP];
+};
+struct tracering_t *tring; /* The trace ring */
+
+struct reap_t
+{                     /* A child status collected by waitpid */
+    pid_t pid;        /* child PID */
+    int status;       /* status as returned by waitpid */
+    struct rusage ru; /* its resource use, if it exited */
+};
+/* End global variables */
+
+/* Function prototypes */
+
+/* Here are the functions that you will implement */
+pid_t eval(char *cmdline);
+pid_t evaljob(char *cmdline, struct job_t *pending);
+int builtin_cmd(char **argv);
+void do_jobs(char **argv);
+void do_bgfgkl(char **argv);
+void do_export(char **argv);
+void do_hash(char **argv);
+void do_cat(char **argv);
+void do_echo(char **argv);
+void do_printf(char **argv);
+int do_test(char **argv);
+void do_pwd(char **argv);
+void do_jtop(char **argv);
+void do_setaffinity(char **argv);
+void do_spread(char **argv);
+void do_parallel(char **argv);
+void do_trace(char **argv);
+void do_capture(char **argv);
+int builtin_io(char **argv, int *io);
+void waitfg(pid_t pid);
+pid_t launch(char **argv, sigset_t *mask, pid_t pgid, int *io, cpu_set_t *cpus);
+int startzygote(void);
+void zygote(int fd);
+int zygotechild(void *arg);
+pid_t zygotelaunch(char *path, char **argv, sigset_t *mask, pid_t pgid,
+                   int *io, cpu_set_t *cpus);
+void forgetzygote(struct evloop_t *ev);
+int readall(int fd, char *buf, size_t len);
+
+void sigchld_handler(int sig);
+void sigtstp_handler(int sig);
+void sigint_handler(int sig);
+
+/* Here are helper routines that we've provided for you */
+int parseline(const char *cmdline, struct arena_t *a, struct words_t *w);
+void addword(struct arena_t *a, struct words_t *w, int *cap, char *word);
+char *wordend(char *p);
+void *arenaalloc(struct arena_t *a, size_t size);
+void arenareset(struct arena_t *a);
+int splitpipe(char **argv, char ***stages);
+int parseredir(char **argv, struct redir_t *r);
+int openredir(struct redir_t *r);
+void closeredir(struct redir_t *r);
+void sigquit_handler(int sig);
+
+void initloop(struct evloop_t *ev);
+void watchinput(struct evloop_t *ev, int fd);
+int swapinput(struct evloop_t *ev, int fd);
+int runevents(struct evloop_t *ev, int wantinput);
+void dispatchsignals(struct evloop_t *ev);
+int watchchild(struct evloop_t *ev, pid_t pid);
+int reapchild(struct evloop_t *ev, uint64_t data, struct reap_t *r);
+int signaljob(struct job_t *job, int sig);
+void settimer(struct evloop_t *ev, double secs);
+int opencapture(int *fds);
+void watchcapture(struct evloop_t *ev, struct job_t *job, int fd);
+void drainoutput(struct evloop_t *ev, struct job_t *job);
+void endcapture(struct evloop_t *ev, struct job_t *job);
+void freecapture(struct capture_t *c);
+uint64_t printcapture(struct capture_t *c, uint64_t from);
+
+void *poolalloc(struct strpool_t *sp, size_t size);
+void poolrelease(struct strpool_t *sp, void *cell, size_t size);
+char *pooldup(struct strpool_t *sp, const char *str);
+void poolfree(struct strpool_t *sp, char *str);
+int poolclass(size_t size);
+
+void clearjob(struct job_t *job);
+void initjobs(struct joblist_t *jl);
+int maxjid(struct joblist_t *jl);
+int pidhash(struct joblist_t *jl, pid_t pid);
+int pidslot(struct joblist_t *jl, pid_t pid);
+void unhashpid(struct joblist_t *jl, pid_t pid, int jid);
+int growjobs(struct joblist_t *jl, int nprocs);
+int addjob(struct joblist_t *jl, pid_t pid, int state, char *cmdline);
+int addpipejob(struct joblist_t *jl, pid_t *pids, int n, int state, char *cmdline);
+struct job_t *newjob(struct joblist_t *jl, int state, char *cmdline);
+int setjobprocs(struct joblist_t *jl, struct job_t *job, pid_t *pids, int n,
+                int state);
+int deletejob(struct joblist_t *jl, pid_t pid);
+void removejob(struct joblist_t *jl, struct job_t *job);
+struct job_t *deferjob(struct joblist_t *jl, char **argv, char *cmdline);
+void takewords(struct job_t *job, struct arena_t *a, struct words_t *w);
+void resolveafter(struct joblist_t *jl, int jid, int ok);
+void runready(struct joblist_t *jl);
+int waitingjobs(struct joblist_t *jl);
+int stoppedafter(struct joblist_t *jl, struct job_t *job);
+void setjobstate(struct joblist_t *jl, struct job_t *job, int state);
+void reapjobs(struct joblist_t *jl, struct reap_t *batch, int n);
+void addusage(struct jobstats_t *st, struct rusage *ru);
+void procusage(pid_t pid, struct jobstats_t *st);
+void printtimes(struct jobstats_t *st);
+double elapsed(struct timespec *from, struct timespec *to);
+pid_t fgpid(struct joblist_t *jl);
+struct job_t *getjobpid(struct joblist_t *jl, pid_t pid);
+struct job_t *getjobjid(struct joblist_t *jl, int jid);
+int pid2jid(pid_t pid);
+void listjobs(struct joblist_t *jl, int usage);
+int parsestat(const char *buf, pid_t *pgrp, unsigned long long *utime,
+              unsigned long long *stime);
+
+void rebuildsampler(struct sampler_t *sp, struct joblist_t *jl);
+int addproc(struct procstat_t **procs, int *n, int *cap, pid_t pid, int jid,
+            pid_t pgid, struct sampler_t *old);
+struct procstat_t *findproc(struct sampler_t *sp, pid_t pid);
+int cmpproc(const void *a, const void *b);
+void closeproc(struct procstat_t *p);
+double takesample(struct sampler_t *sp, struct joblist_t *jl);
+void printsample(struct sampler_t *sp, struct joblist_t *jl, double dt);
+
+int parsecpus(const char *list, cpu_set_t *set);
+int readcpus(const char *path, cpu_set_t *set);
+void printcpus(cpu_set_t *set);
+int setspread(struct spread_t *sp, int mode);
+int pickplace(struct spread_t *sp);
+int setjobaffinity(struct job_t *job, cpu_set_t *set);
+
+void inittrace(void);
+uint64_t tracetime(void);
+uint64_t monotonic_ns(void);
+void tracepoint(int type, pid_t pid, int jid, int arg);
+void tracepointat(uint64_t t, int type, pid_t pid, int jid, int arg);
+int copytrace(struct trevent_t **evp, double *nspertick);
+int cmptrace(const void *a, const void *b);
+void dumptrace(FILE *fp, int binary);
+
+void initcmds(struct cmdcache_t *cc, const char *path);
+void clearcmds(struct cmdcache_t *cc);
+int checkcmddirs(struct cmdcache_t *cc);
+int cmdslot(struct cmdcache_t *cc, const char *name);
+char *findcmd(struct cmdcache_t *cc, const char *name);
+void listcmds(struct cmdcache_t *cc);
+
+void initenv(struct envtab_t *et, char **envp);
+int envslot(struct envtab_t *et, const char *name, size_t namelen);
+char *getenvvar(struct envtab_t *et, const char *name);
+void setenvvar(struct envtab_t *et, const char *name, size_t namelen,
+               const char *value);
+char **buildenv(struct envtab_t *et);
+
+void openreader(struct reader_t *r, int fd);
+void closereader(struct reader_t *r);
+void stringreader(struct reader_t *r, char *str);
+char *nextline(struct reader_t *r);
+
+char *fastname(char *cmd);
+void cmderror(const char *fmt, ...);
+int printesc(const char *s, int octal0, int echo);
+int printformat(const char *fmt, char **args, int *stop);
+intmax_t intarg(const char *arg);
+long double floatarg(const char *arg);
+int testargs(char **argv, int n);
+int testexpr(char **argv, int *pos, int n);
+int testand(char **argv, int *pos, int n);
+int testterm(char **argv, int *pos, int n);
+int isunaryop(const char *op);
+int isbinaryop(const char *op);
+int testunary(const char *op, const char *arg);
+int testbinary(const char *l, const char *op, const char *r);
+int testint(const char *arg, long long *val);
+
+int catbuiltin(char **argv);
+int copyfd(int in, int out);
+int writeall(int fd, const char *buf, size_t len);
+
+void usage(void);
+void unix_error(char *msg);
+void app_error(char *msg);
+
+/*
+ * main - The shell's main routine
+ */
+int main(int argc, char **argv)
+{
+    char c;
+    char *cmdline;
+    char *command = NULL; /* -c command */
+    int fd, i, jid;
+    int emit_prompt = 1; /* emit prompt (default) */
+
+    /* Redirect stderr to stdout (so that driver will get all output
+     * on the pipe connected to stdout) */
+    dup2(1, 2);
+
+    /* Parse the command line */
+    while ((c = getopt(argc, argv, "hvpszEoc:")) != EOF)
+    {
+        switch (c)
+        {
+        case 'h': /* print help message */
+            usage();
+            break;
+        case 'v': /* emit additional diagnostic info */
+            verbose = 1;
+            break;
+        case 'p':            /* don't print a prompt */
+            emit_prompt = 0; /* handy for automatic testing */
+            break;
+        case 's': /* launch jobs with posix_spawn instead of fork */
+            use_spawn = 1;
+            break;
+        case 'z': /* launch jobs through a zygote */
+            use_zygote = 1;
+            break;
+        case 'E': /* don't run echo, printf, ... in the shell */
+            use_external = 1;
+            break;
+        case 'o': /* capture the output of background jobs */
+            use_capture = 1;
+            break;
+        case 'c': /* run the command string instead of reading stdin */
+            command = optarg;
+            emit_prompt = 0;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    /* Map the trace ring (it is off until "trace on"), and then fork the
+     * zygote while the shell is still small and has nothing open that the
+     * zygote shouldn't hold */
+    inittrace();
+    if (use_zygote)
+        zygotefd = startzygote();
+
+    /* Open the input: -c string, script file or stdin */
+    if (command)
+    {
+        stringreader(&input, command);
+    }
+    else if (optind < argc)
+    {
+        if ((fd = open(argv[optind], O_RDONLY | O_CLOEXEC)) < 0)
+            unix_error(argv[optind]);
+        openreader(&input, fd);
+        emit_prompt = 0;
+    }
+    else
+    {
+        openreader(&input, STDIN_FILENO);
+    }
+
+    /* Batch output that isn't going to a terminal: it is flushed before
+     * a child is started, after a command that started one and before
+     * we wait for more input, instead of after every line */
+    if (!isatty(STDOUT_FILENO))
+        setvbuf(stdout, NULL, _IOFBF, OUTBUF);
+
+    /* Route SIGINT (ctrl-c), SIGTSTP (ctrl-z), SIGCHLD and SIGQUIT (the
+     * driver's clean way to kill the shell) to the event loop */
+    initloop(&loop);
+    if (input.fd >= 0)
+        watchinput(&loop, input.fd);
+
+    /* Initialize the job list, the environment and the command hash */
+    initjobs(&jobs);
+    initenv(&shellenv, environ);
+    initcmds(&cmdcache, getenvvar(&shellenv, "PATH"));
+
+    /* Execute the shell's read/eval loop */
+    while (1)
+    {
+        /* Read command line */
+        if (emit_prompt)
+        {
+            printf("%s", prompt);
+            fflush(stdout);
+        }
+        if ((cmdline = nextline(&input)) == NULL)
+        { /* End of file (ctrl-d); pending jobs only live in the shell */
+            loop.intr = 0;
+            while (waitingjobs(&jobs) && !loop.intr)
+                runevents(&loop, 0);
+            for (i = 1; i <= jobs.maxjid; i++)
+                if (jobs.byjid[i] && jobs.byjid[i]->state == PD &&
+                    (jid = stoppedafter(&jobs, jobs.byjid[i])) != 0)
+                    printf("Job [%d] not run: job [%d] is stopped\n", i, jid);
+            fflush(stdout);
+            exit(0);
+        }
+
+        /* Evaluate the command line */
+        eval(cmdline);
+    }
+
+    exit(0); /* control never reaches here */
+}
+
+/*
+ * eval - Evaluate the command line that the user has just typed in
+ *
+ * If the user has requested a built-in command (quit, jobs, bg or fg)
+ * then execute it immediately. Otherwise, fork a child process and
+ * run the job in the context of the child. If the job is running in
+ * the foreground, wait for it to terminate and then return.  Note:
+ * each child process must have a unique process group ID so that our
+ * background children don't receive SIGINT (SIGTSTP) from the kernel
+ * when we type ctrl-c (ctrl-z) at the keyboard.
+ *
+ * A pipeline (cmd1 | cmd2 | ...) is one job: every stage goes into the
+ * process group of the first one, so signals and fg/bg reach all of them.
+ * Each stage may redirect its stdin (< file), its stdout (> file or
+ * >> file, which win over the pipe) and its stderr (2>&1). The files are
+ * opened here, close-on-exec, and launch() moves them into place.
+ *
+ * Output is flushed before the children are started, so they don't
+ * inherit it and it comes out before theirs, and again once the
+ * command is done. A line that runs only builtins leaves its output in
+ * the buffer.
+ *
+ * A line that starts with "time" is run as if it didn't, and then what
+ * it used is reported on stderr: the job's rusage from the reaper, or
+ * for a builtin, what the shell itself used meanwhile. A background job
+ * isn't timed; jobs -l shows what it has used so far.
+ *
+ * After that, "pin <cpu list>" runs every stage of the job on those
+ * CPUs. Otherwise a background job goes where spread puts it, if it is
+ * on, and anything else gets the shell's own affinity.
+ *
+ * A line "after %1 %2 -- command" puts a background job on the list that
+ * waits for jobs 1 and 2 and runs the rest of the line once all of them
+ * have succeeded; see deferjob().
+ *
+ * With capture on, the stdout of the last stage and the stderr of every
+ * stage of a background job go to one pipe the shell reads (where they
+ * aren't redirected); see struct capture_t.
+ *
+ * Returns the PID of the background job it started, or 0.
+ */
+pid_t eval(char *cmdline)
+{
+    return evaljob(cmdline, NULL);
+}
+
+/*
+ * evaljob - Evaluate a command line as eval() does; with pending, the
+ *     line of that pending job, which is started as it (in the
+ *     background, without a word) now that its wait is over. Its words
+ *     are those deferjob() kept, so a $VAR has the value it had then. A
+ *     pending job that turns out to be a builtin is done once it has run.
+ */
+pid_t evaljob(char *cmdline, struct job_t *pending)
+{
+    struct words_t words;
+    char **argv;
+    char ***stages;          /* argv of each pipeline stage */
+    struct redir_t *redirs;  /* and its redirections */
+    pid_t *pids;             /* the stages that were started */
+    int bg, i, n, npids, fds[2], io[3], in, out, next, pidfd, leaderfd = -1;
+    int timed, place = -1, capfds[2] = {-1, -1};
+    int lost = 0; /* exit status of a last stage that wasn't started */
+    int opened = 0; /* the redirections of a single stage are open */
+    pid_t pid;
+    cpu_set_t pinned, *cpus = NULL;
+    struct job_t *job;
+    struct timespec forked, execd;
+    struct jobstats_t self;
+    struct rusage ru0, ru1;
+
+    arenareset(&linearena);
+    if (pending)
+    {
+        takewords(pending, &linearena, &words);
+        bg = 1;
+    }
+    else
+        bg = parseline(cmdline, &linearena, &words);
+    tracepoint(TR_PARSE, 0, 0, words.argc);
+    argv = words.argv;
+    if (!pending && argv[0] != NULL && !strcmp(argv[0], "after"))
+    {
+        if ((job = deferjob(&jobs, argv + 1, cmdline)) != NULL)
+        {
+            if (announce)
+                printf("[%d] (-) %s", job->jid, cmdline);
+            if (jobs.ready)
+                runready(&jobs); /* it waits for nothing */
+        }
+        return 0;
+    }
+    if ((timed = argv[0] != NULL && !strcmp(argv[0], "time")) != 0)
+    {
+        argv++;
+        memset(&self, 0, sizeof(self));
+        clock_gettime(CLOCK_MONOTONIC, &self.forked);
+        getrusage(RUSAGE_SELF, &ru0);
+    }
+    if (argv[0] == NULL)
+    {
+        if (timed)
+        {
+            self.exited = self.forked;
+            printtimes(&self);
+        }
+        return 0;
+    }
+    if (!strcmp(argv[0], "pin"))
+    {
+        if (argv[1] == NULL || argv[2] == NULL || !parsecpus(argv[1], &pinned))
+        {
+            printf("pin: usage: pin <cpu list> command\n");
+            return 0;
+        }
+        argv += 2;
+        cpus = &pinned;
+    }
+    n = words.argc + 1; /* there can't be more stages than that */
+    stages = arenaalloc(&linearena, n * sizeof(char **));
+    redirs = arenaalloc(&linearena, n * sizeof(struct redir_t));
+    pids = arenaalloc(&linearena, n * sizeof(pid_t));
+    if ((n = splitpipe(argv, stages)) == 0)
+    {
+        printf("syntax error near unexpected token `|'\n");
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (!parseredir(stages[i], &redirs[i]))
+        {
+            printf("syntax error near redirection\n");
+            return 0;
+        }
+    }
+    /* echo, cat and the like stand in for programs: in the background,
+     * the programs are run, so that they are jobs like any other */
+    if (n == 1 && !(bg && (fastname(argv[0]) ||
+                           (!strcmp(argv[0], "cat") && catbuiltin(argv)))))
+    {
+        if (!openredir(&redirs[0]))
+            return 0;
+        opened = 1;
+        io[0] = redirs[0].fd[0];
+        io[1] = redirs[0].fd[1];
+        io[2] = redirs[0].errout ? (io[1] >= 0 ? io[1] : STDOUT_FILENO) : -1;
+        if (builtin_io(argv, io))
+        {
+            closeredir(&redirs[0]);
+            if (timed)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &self.exited);
+                getrusage(RUSAGE_SELF, &ru1);
+                timersub(&ru1.ru_utime, &ru0.ru_utime, &ru1.ru_utime);
+                timersub(&ru1.ru_stime, &ru0.ru_stime, &ru1.ru_stime);
+                ru1.ru_nvcsw -= ru0.ru_nvcsw;
+                ru1.ru_nivcsw -= ru0.ru_nivcsw;
+                addusage(&self, &ru1); /* the shell's own max RSS */
+                printtimes(&self);
+            }
+            if (pending)
+            { /* its dependents go by how the builtin did */
+                pending->status = W_EXITCODE(builtin_status, 0);
+                removejob(&jobs, pending);
+            }
+            return 0;
+        }
+    }
+
+    if (bg && cpus == NULL && (place = pickplace(&spread)) >= 0)
+        cpus = &spread.sets[place];
+    if (bg && use_capture && !opencapture(capfds))
+        return 0;
+    fflush(stdout);
+    buildenv(&shellenv);
+    clock_gettime(CLOCK_MONOTONIC, &forked);
+    execd = forked;
+    in = -1;
+    for (i = npids = 0; i < n; i++)
+    {
+        out = next = -1;
+        if (i < n - 1)
+        { /*close-on-exec, so a stage only keeps the ends it dup2s*/
+            if (pipe2(fds, O_CLOEXEC) < 0)
+                unix_error("pipe error");
+            next = fds[0];
+            out = fds[1];
+        }
+        if (opened || openredir(&redirs[i]))
+        {
+            io[0] = redirs[i].fd[0] >= 0 ? redirs[i].fd[0] : in;
+            io[1] = redirs[i].fd[1] >= 0 ? redirs[i].fd[1]
+                                         : out >= 0 ? out : capfds[1];
+            io[2] = redirs[i].errout ? (io[1] >= 0 ? io[1] : STDOUT_FILENO)
+                                     : capfds[1];
+            if ((pid = launch(stages[i], &shellmask, npids ? pids[0] : 0, io,
+                              cpus)) != 0)
+            {
+                pidfd = watchchild(&loop, pid);
+                if (npids == 0)
+                {
+                    leaderfd = pidfd;
+                    clock_gettime(CLOCK_MONOTONIC, &execd);
+                }
+                pids[npids++] = pid;
+            }
+            else if (i == n - 1)
+            {
+                lost = 127; /* as a shell's child that can't exec */
+            }
+            closeredir(&redirs[i]);
+        }
+        else if (i == n - 1)
+        {
+            lost = 1;
+        }
+        if (in >= 0)
+            close(in);
+        if (out >= 0)
+            close(out);
+        in = next;
+    }
+    if (capfds[1] >= 0)
+        close(capfds[1]); /* the stages have it: EOF once they are done */
+    if (npids == 0)
+    {
+        if (capfds[0] >= 0)
+            close(capfds[0]);
+        return 0;
+    }
+    pid = pids[0];
+    /* no child is reaped before it is on the list: that only happens in
+     * the event loop */
+    if ((pending ? setjobprocs(&jobs, pending, pids, npids, BG)
+                 : addpipejob(&jobs, pids, npids, bg ? BG : FG, cmdline)) &&
+        (job = getjobpid(&jobs, pid)) != NULL)
+    {
+        job->pidfd = leaderfd; /* borrowed from the watch */
+        if (lost) /* the job has failed, whatever becomes of its writers */
+            job->status = W_EXITCODE(lost, 0);
+        job->stats.forked = forked;
+        job->stats.execd = execd;
+        if (place >= 0)
+        {
+            job->place = place;
+            spread.load[place]++;
+        }
+        if (capfds[0] >= 0)
+        {
+            watchcapture(&loop, job, capfds[0]);
+            capfds[0] = -1;
+        }
+    }
+    if (capfds[0] >= 0)
+        close(capfds[0]);
+    if (!bg)
+    {
+        jobs.lastpid = 0;
+        waitfg(pid); /*wait until foreground process terminates or receives interrupt*/
+        if (timed && jobs.lastpid == pid)
+            printtimes(&jobs.last); /* it finished rather than stopped */
+    }
+    else if (announce && !pending)
+        printf("[%d] (%d) %s", pid2jid(pid), pid, cmdline);
+    fflush(stdout);
+    return bg ? pid : 0;
+}
+
+/*
+ * launch - Start argv[0] as a child in process group pgid (a new group
+ *     of its own if pgid is 0), with its signal mask set to mask and
+ *     io[0..2] (unless -1) as its stdin, stdout and stderr, and on the
+ *     CPUs in cpus (unless NULL). A name without a '/' is looked up on
+ *     $PATH through the command hash. Returns the child's PID, or 0 if
+ *     it wasn't started.
+ *
+ * By default the child is forked. With -s it is started by posix_spawn,
+ * which doesn't copy the shell's page tables (glibc uses a CLONE_VFORK
+ * child), and an exec failure is reported back to us instead of by the
+ * child. posix_spawn has no attribute for the affinity, so the child is
+ * moved once it is running; it may have taken its first steps elsewhere.
+ * With -z the zygote starts it (see zygotelaunch()), or fork does if the
+ * zygote is gone.
+ */
+pid_t launch(char **argv, sigset_t *mask, pid_t pgid, int *io, cpu_set_t *cpus)
+{
+    char *path;
+    pid_t pid;
+    int fd, redirected = io[0] >= 0 || io[1] >= 0 || io[2] >= 0;
+    uint64_t t = tracetime(); /* for the fork event, once there's a PID */
+
+    if ((path = findcmd(&cmdcache, argv[0])) == NULL)
+    {
+        printf("%s: Command not found\n", argv[0]);
+        return 0;
+    }
+
+    if (zygotefd >= 0 && (pid = zygotelaunch(path, argv, mask, pgid, io, cpus)) >= 0)
+    {
+        if (pid == 0)
+            return 0; /* the zygote couldn't clone; fork likely can't either */
+        tracepointat(t, TR_FORK, pid, 0, 0);
+        setpgid(pid, pgid ? pgid : pid); /* as for fork, before we go on */
+        return pid;
+    }
+
+    if (use_spawn)
+    {
+        posix_spawnattr_t attr;
+        posix_spawn_file_actions_t fa;
+        int err;
+
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                            POSIX_SPAWN_SETSIGMASK);
+        posix_spawnattr_setpgroup(&attr, pgid);
+        posix_spawnattr_setsigmask(&attr, mask);
+        if (redirected)
+        {
+            posix_spawn_file_actions_init(&fa);
+            for (fd = 0; fd < 3; fd++)
+                if (io[fd] >= 0)
+                    posix_spawn_file_actions_adddup2(&fa, io[fd], fd);
+        }
+        err = posix_spawn(&pid, path, redirected ? &fa : NULL, &attr, argv,
+                          shellenv.envp);
+        if (redirected)
+            posix_spawn_file_actions_destroy(&fa);
+        posix_spawnattr_destroy(&attr);
+        if (err)
+        {
+            printf("%s: Command not found\n", argv[0]);
+            return 0;
+        }
+        tracepointat(t, TR_FORK, pid, 0, 0);
+        tracepoint(TR_EXEC, pid, 0, 0); /* posix_spawn waited for it */
+        if (cpus)
+            sched_setaffinity(pid, sizeof(*cpus), cpus);
+        return pid;
+    }
+
+    fflush(stdout); /* a "Command not found" of an earlier stage */
+    if ((pid = fork()) < 0)
+        unix_error("fork error");
+    if (pid == 0)
+    {
+        setpgid(0, pgid);
+        sigprocmask(SIG_SETMASK, mask, NULL);
+        if (cpus)
+            sched_setaffinity(0, sizeof(*cpus), cpus);
+        for (fd = 0; fd < 3; fd++)
+            if (io[fd] >= 0)
+                dup2(io[fd], fd);
+        tracepoint(TR_EXEC, getpid(), 0, 0);
+        if (execve(path, argv, shellenv.envp) < 0)
+        {
+            printf("%s: Command not found\n", argv[0]);
+            exit(0);
+        }
+    }
+    tracepointat(t, TR_FORK, pid, 0, 0);
+    setpgid(pid, pgid ? pgid : pid); /*so later stages can join the group*/
+    return pid;
+}
+
+/*
+ * startzygote - Fork the zygote and return our end of its socketpair.
+ *
+ * The zygote goes into a process group of its own, so the signals typed
+ * at the terminal don't reach it, and leaves when the shell closes the
+ * socket. It stays our child; the children it makes are too.
+ */
+int startzygote(void)
+{
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+        unix_error("socketpair error");
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+        unix_error("fork error");
+    if (pid == 0)
+    {
+        close(sv[0]);
+        setpgid(0, 0);
+        zygote(sv[1]);
+    }
+    close(sv[1]);
+    zygotepid = pid;
+    return sv[0];
+}
+
+/*
+ * zygote - Serve launch requests on fd until the shell goes away.
+ *
+ * The child is cloned with CLONE_PARENT, which makes it the shell's
+ * child rather than ours: the shell's setpgid(), pidfd and waitid work
+ * on it as on a child it forked, and its stops and exit are reported
+ * to the shell. Like posix_spawn's, it shares our memory (CLONE_VM) and
+ * runs on a stack of its own while we are suspended (CLONE_VFORK)
+ * until it has exec'd or exited, so starting it copies no page tables.
+ * The fds it was passed are close-on-exec, so after the dup2s it keeps
+ * just its stdin, stdout and stderr.
+ */
+void zygote(int fd)
+{
+    struct zyreq_t req;
+    union
+    { /* aligned for the cmsghdr */
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } ctl;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    struct zychild_t child;
+    char *buf = NULL, *p, **args = NULL, *stack;
+    size_t bufsize = 0;
+    int fds[3], nfds, nargs = 0, i;
+    ssize_t n;
+    pid_t pid;
+
+    if ((stack = mmap(NULL, ZYGOTESTACK, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0)) == MAP_FAILED)
+        _exit(1);
+
+    while (1)
+    {
+        iov.iov_base = &req;
+        iov.iov_len = sizeof(req);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = sizeof(ctl.buf);
+        if ((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) <= 0)
+            _exit(0); /* the shell is gone */
+        nfds = 0;
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+            {
+                nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                memcpy(fds, CMSG_DATA(cm), nfds * sizeof(int));
+            }
+        }
+        if (!readall(fd, (char *)&req + n, sizeof(req) - n))
+            _exit(0);
+        if (req.len > bufsize && (buf = realloc(buf, bufsize = req.len)) == NULL)
+            _exit(1);
+        if (req.argc + req.envc + 2 > nargs &&
+            (args = realloc(args, (nargs = req.argc + req.envc + 2) *
+                                      sizeof(char *))) == NULL)
+            _exit(1);
+        if (!readall(fd, buf, req.len))
+            _exit(0);
+
+        /* args holds argv, NULL, envp, NULL */
+        p = buf + strlen(buf) + 1;
+        for (i = 0; i < req.argc + req.envc + 2; i++)
+        {
+            if (i == req.argc || i == req.argc + req.envc + 1)
+            {
+                args[i] = NULL;
+                continue;
+            }
+            args[i] = p;
+            p += strlen(p) + 1;
+        }
+
+        child.req = &req;
+        child.path = buf;
+        child.argv = args;
+        child.envp = args + req.argc + 1;
+        child.fds = fds;
+        child.nfds = nfds;
+        if ((pid = clone(zygotechild, stack + ZYGOTESTACK,
+                         CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD,
+                         &child)) < 0)
+            pid = -errno;
+        for (i = 0; i < nfds; i++)
+            close(fds[i]);
+        if (write(fd, &pid, sizeof(pid)) != sizeof(pid))
+            _exit(0);
+    }
+}
+
+/*
+ * zygotechild - The child of the zygote: does what launch()'s forked
+ *     child does and execs. It shares the zygote's memory, so it leaves
+ *     stdio alone and says why it couldn't exec with a write. Returning
+ *     exits it.
+ */
+int zygotechild(void *arg)
+{
+    struct zychild_t *c = arg;
+    char msg[MAXLINE];
+    int i;
+
+    setpgid(0, c->req->pgid);
+    sigprocmask(SIG_SETMASK, &c->req->mask, NULL);
+    if (c->req->pinned)
+        sched_setaffinity(0, sizeof(c->req->cpus), &c->req->cpus);
+    for (i = 0; i < 3; i++)
+        if (c->req->io[i] >= 0 && c->req->io[i] < c->nfds)
+            dup2(c->fds[c->req->io[i]], i);
+    tracepoint(TR_EXEC, getpid(), 0, 0);
+    execve(c->path, c->argv, c->envp);
+    i = snprintf(msg, sizeof(msg), "%s: Command not found\n", c->argv[0]);
+    if (write(STDOUT_FILENO, msg, i < (int)sizeof(msg) ? i : (int)sizeof(msg) - 1) < 0)
+        return 1;
+    return 0; /* the exit status; no _exit, which ASan objects to here */
+}
+
+/*
+ * zygotelaunch - Ask the zygote to start path as launch() would have.
+ *     Returns the child's PID, 0 if the zygote couldn't clone one (as
+ *     for a fork error, which is printed, but only the job fails), or
+ *     -1 if the zygote is gone (then it is forgotten, and launch() forks
+ *     as if there had never been one). The request is built in the line
+ *     arena.
+ */
+pid_t zygotelaunch(char *path, char **argv, sigset_t *mask, pid_t pgid,
+                   int *io, cpu_set_t *cpus)
+{
+    struct zyreq_t *req;
+    union
+    { /* aligned for the cmsghdr */
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } ctl;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    char **envp = shellenv.envp, *p;
+    size_t len, total, sent;
+    int fds[3], nfds = 0, argc, envc, i;
+    ssize_t n;
+    pid_t pid;
+
+    len = strlen(path) + 1;
+    for (argc = 0; argv[argc]; argc++)
+        len += strlen(argv[argc]) + 1;
+    for (envc = 0; envp[envc]; envc++)
+        len += strlen(envp[envc]) + 1;
+    total = sizeof(*req) + len;
+    req = arenaalloc(&linearena, total);
+    memset(req, 0, sizeof(*req));
+    req->len = len;
+    req->argc = argc;
+    req->envc = envc;
+    req->pgid = pgid;
+    req->mask = *mask;
+    if ((req->pinned = cpus != NULL) != 0)
+        req->cpus = *cpus;
+    for (i = 0; i < 3; i++)
+    {
+        req->io[i] = io[i] >= 0 ? nfds : -1;
+        if (io[i] >= 0)
+            fds[nfds++] = io[i];
+    }
+    p = stpcpy((char *)(req + 1), path) + 1;
+    for (i = 0; i < argc; i++)
+        p = stpcpy(p, argv[i]) + 1;
+    for (i = 0; i < envc; i++)
+        p = stpcpy(p, envp[i]) + 1;
+
+    iov.iov_base = req;
+    iov.iov_len = total;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds)
+    {
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+    }
+    /* the fds go with the first send; a long environment may take more */
+    n = sendmsg(zygotefd, &msg, MSG_NOSIGNAL);
+    for (sent = 0; n > 0 && (sent += n) < total;)
+        n = send(zygotefd, (char *)req + sent, total - sent, MSG_NOSIGNAL);
+    if (sent < total || !readall(zygotefd, (char *)&pid, sizeof(pid)))
+    {
+        forgetzygote(&loop);
+        return -1;
+    }
+    if (pid < 0)
+    {
+        printf("fork error: %s\n", strerror(-pid));
+        return 0;
+    }
+    return pid;
+}
+
+/*
+ * forgetzygote - The zygote is gone, or can't be talked to: stop
+ *     watching its socket, close it and reap the zygote, which is dead
+ *     or about to be once its socket is closed. Jobs are forked from
+ *     now on.
+ */
+void forgetzygote(struct evloop_t *ev)
+{
+    epoll_ctl(ev->epfd, EPOLL_CTL_DEL, zygotefd, NULL);
+    close(zygotefd);
+    zygotefd = -1;
+    while (waitpid(zygotepid, NULL, 0) < 0 && errno == EINTR)
+        ;
+    zygotepid = -1;
+}
+
+/* readall - Read exactly len bytes of fd into buf; 1, or 0 on EOF or error */
+int readall(int fd, char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0)
+    {
+        if ((n = read(fd, buf, len)) <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return 0;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/*
+ * parseline - Parse the command line and build the argv array.
+ *
+ * Characters enclosed in single quotes are treated as a single
+ * argument.  Return true if the user has requested a BG job, false if
+ * the user has requested a FG job.
+ *
+ * The line is copied once into the arena a and cut into words in place;
+ * a $VAR word is replaced by a copy of the value of VAR, looked up in
+ * the environment hash (and is dropped if VAR is not set). Word ends
+ * are found 16 bytes at a time by wordend() and closing quotes by
+ * memchr, so the line is scanned once. Blanks are spaces and control
+ * characters. An unquoted | is a word of its own even when it touches
+ * its neighbours; <, >, >> and 2>&1 are only redirections at the start
+ * of a word (parseredir() takes them apart), so text like "tsh>" is
+ * left alone. There is no limit on the length of the line or the
+ * number of words, and no static state.
+ */
+int parseline(const char *cmdline, struct arena_t *a, struct words_t *w)
+{
+    size_t len = strlen(cmdline), vlen;
+    char *buf, *end, *p, *q, c;
+    int cap = ARGVMIN; /* slots in w->argv */
+
+    buf = arenaalloc(a, len + 16); /* wordend() may read 15 bytes past the NUL */
+    memcpy(buf, cmdline, len + 1);
+    end = buf + len;
+    w->argv = arenaalloc(a, cap * sizeof(char *));
+    w->argv[0] = NULL;
+    w->argc = 0;
+
+    for (p = buf;;)
+    {
+        while (*p && (unsigned char)*p <= ' ') /* ignore spaces */
+            p++;
+        if (*p == '\0')
+            break;
+        if (*p == '\'')
+        { /* quoted: up to the next quote, taken as it is */
+            p++;
+            if ((q = memchr(p, '\'', end - p)) == NULL)
+                q = (end > p && end[-1] == '\n') ? end - 1 : end;
+            c = *q;
+            *q = '\0';
+            addword(a, w, &cap, p);
+            p = c ? q + 1 : q;
+            continue;
+        }
+        q = wordend(p);
+        c = *q;
+        *q = '\0';
+        if (q > p && *p == '$' && p[1])
+        { /* if VAR is set replace the word with its value, else drop it;
+           * copied, as an export on this line may replace it */
+            if ((p = getenvvar(&shellenv, p + 1)) != NULL)
+            {
+                vlen = strlen(p) + 1;
+                addword(a, w, &cap, memcpy(arenaalloc(a, vlen), p, vlen));
+            }
+        }
+        else if (q > p)
+        {
+            addword(a, w, &cap, p);
+        }
+        if (c == '|')
+            addword(a, w, &cap, "|");
+        p = c ? q + 1 : q;
+    }
+
+    if (w->argc == 0) /* ignore blank line */
+        return 1;
+
+    /* should the job run in the background? */
+    if (*w->argv[w->argc - 1] == '&')
+    {
+        w->argv[--w->argc] = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * wordend - Return the first byte at or after p that ends an unquoted
+ *     word: a blank, '|' or the NUL. With SSE2 it tests 16 bytes
+ *     at a time, so up to 15 bytes after the NUL must be readable.
+ */
+char *wordend(char *p)
+{
+#ifdef __SSE2__
+    const __m128i blank = _mm_set1_epi8(' '), bar = _mm_set1_epi8('|');
+    __m128i v, hit;
+    unsigned m;
+
+    for (;; p += 16)
+    {
+        v = _mm_loadu_si128((const __m128i *)p);
+        hit = _mm_cmpeq_epi8(_mm_min_epu8(v, blank), v); /* v <= ' ' */
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, bar));
+        if ((m = _mm_movemask_epi8(hit)) != 0)
+            return p + __builtin_ctz(m);
+    }
+#else
+    while ((unsigned char)*p > ' ' && *p != '|')
+        p++;
+    return p;
+#endif
+}
+
+/* addword - Append word to w->argv (of cap slots), keeping it NULL
+ *     terminated */
+void addword(struct arena_t *a, struct words_t *w, int *cap, char *word)
+{
+    char **argv;
+
+    if (w->argc + 2 > *cap)
+    { /* the old array stays in the arena until the next reset */
+        argv = arenaalloc(a, 2 * *cap * sizeof(char *));
+        memcpy(argv, w->argv, w->argc * sizeof(char *));
+        w->argv = argv;
+        *cap *= 2;
+    }
+    w->argv[w->argc++] = word;
+    w->argv[w->argc] = NULL;
+}
+
+/*
+ * splitpipe - Cut argv at each "|" word and store the start of every
+ *     stage in stages. Returns the number of stages, or 0 if one of them
+ *     is empty.
+ */
+int splitpipe(char **argv, char ***stages)
+{
+    int i, n = 0;
+
+    stages[n++] = argv;
+    for (i = 0; argv[i]; i++)
+    {
+        if (!strcmp(argv[i], "|"))
+        {
+            argv[i] = NULL;
+            stages[n++] = &argv[i + 1];
+        }
+    }
+    for (i = 0; i < n; i++)
+        if (stages[i][0] == NULL)
+            return 0;
+    return n;
+}
+
+/*
+ * parseredir - Remove the redirection words (< file, > file, >> file and
+ *     2>&1; the file may also be attached, as in >file) from argv and
+ *     record them in r. Returns 0 if a file or the command is missing.
+ */
+int parseredir(char **argv, struct redir_t *r)
+{
+    char **dst = argv, **start = argv, *w, *file;
+    int skip; /* length of the operator */
+
+    r->in = r->out = NULL;
+    r->append = r->errout = 0;
+    r->fd[0] = r->fd[1] = -1;
+    for (; (w = *argv) != NULL; argv++)
+    {
+        if (!strcmp(w, "2>&1"))
+        {
+            r->errout = 1;
+            continue;
+        }
+        if (*w != '<' && *w != '>')
+        {
+            *dst++ = w;
+            continue;
+        }
+        skip = (w[0] == '>' && w[1] == '>') ? 2 : 1;
+        if ((file = w[skip] ? w + skip : *++argv) == NULL)
+            return 0;
+        if (*w == '<')
+        {
+            r->in = file;
+        }
+        else
+        {
+            r->out = file;
+            r->append = (skip == 2);
+        }
+    }
+    *dst = NULL;
+    return dst != start;
+}
+
+/*
+ * openredir - Open the files named by the redirections in r. Returns 0
+ *     (with nothing left open) if one of them can't be opened.
+ */
+int openredir(struct redir_t *r)
+{
+    if (r->in && (r->fd[0] = open(r->in, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        printf("%s: %s\n", r->in, strerror(errno));
+        return 0;
+    }
+    if (r->out &&
+        (r->fd[1] = open(r->out, O_WRONLY | O_CREAT | O_CLOEXEC |
+                                     (r->append ? O_APPEND : O_TRUNC),
+                         0666)) < 0)
+    {
+        printf("%s: %s\n", r->out, strerror(errno));
+        closeredir(r);
+        return 0;
+    }
+    return 1;
+}
+
+/* closeredir - Close the files opened by openredir */
+void closeredir(struct redir_t *r)
+{
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (r->fd[i] >= 0)
+            close(r->fd[i]);
+        r->fd[i] = -1;
+    }
+}
+
+/*
+ * builtin_cmd - If the user has typed a built-in command then execute
+ *    it immediately, leaving its exit status in builtin_status (1 for
+ *    false, test's result, 0 for the rest).
+ */
+int builtin_cmd(char **argv)
+{
+    char *name;
+
+    builtin_status = 0;
+    if (!strcmp(argv[0], "quit"))
+    {
+        exit(0);
+    }
+    if (!strcmp(argv[0], "jobs"))
+    {
+        do_jobs(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "bg") || !strcmp(argv[0], "fg") || !strcmp(argv[0], "kill"))
+    {
+        do_bgfgkl(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "export"))
+    {
+        do_export(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "jtop"))
+    {
+        do_jtop(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "setaffinity"))
+    {
+        do_setaffinity(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "spread"))
+    {
+        do_spread(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "parallel"))
+    {
+        do_parallel(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "trace"))
+    {
+        do_trace(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "capture"))
+    {
+        do_capture(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "hash"))
+    {
+        do_hash(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "cat") && catbuiltin(argv))
+    {
+        do_cat(argv);
+        return 1;
+    }
+    if ((name = fastname(argv[0])) != NULL)
+    { /* small commands that are cheaper to run than to launch */
+        if (!strcmp(name, "echo"))
+            do_echo(argv);
+        else if (!strcmp(name, "printf"))
+            do_printf(argv);
+        else if (!strcmp(name, "test") || !strcmp(name, "["))
+            builtin_status = do_test(argv);
+        else if (!strcmp(name, "pwd"))
+            do_pwd(argv);
+        else if (!strcmp(name, "false"))
+            builtin_status = 1;
+        return 1; /* true does nothing */
+    }
+    return 0; /* not a builtin command */
+}
+
+/*
+ * builtin_io - Run argv if it is a built-in command, with stdin, stdout
+ *    and stderr replaced by io[0..2] (where not -1) while it runs.
+ *    Returns 0 if it isn't one.
+ */
+int builtin_io(char **argv, int *io)
+{
+    int saved[3], fd, ret;
+
+    if (io[0] < 0 && io[1] < 0 && io[2] < 0)
+        return builtin_cmd(argv);
+
+    fflush(stdout);
+    for (fd = 0; fd < 3; fd++)
+    {
+        if (io[fd] >= 0)
+        {
+            if ((saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 3)) < 0)
+                unix_error("fcntl error");
+            dup2(io[fd], fd);
+        }
+    }
+    ret = builtin_cmd(argv);
+    fflush(stdout);
+    for (fd = 0; fd < 3; fd++)
+    {
+        if (io[fd] >= 0)
+        {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+        }
+    }
+    return ret;
+}
+
+/*
+ * do_jobs - Execute the builtin jobs command: list the jobs (with -l,
+ *     and what they have used), or with -o %jobid, print the output
+ *     captured from that job that is still in its ring. With -f too,
+ *     go on printing what it prints as it comes, until the job is gone
+ *     or ctrl-c.
+ */
+void do_jobs(char **argv)
+{
+    struct job_t *job;
+    struct capture_t *c;
+    uint64_t mark;
+    int follow;
+
+    if (argv[1] == NULL || strcmp(argv[1], "-o"))
+    {
+        listjobs(&jobs, argv[1] && !strcmp(argv[1], "-l"));
+        return;
+    }
+    follow = argv[2] && argv[3] && !strcmp(argv[3], "-f");
+    if (argv[2] == NULL || argv[2][0] != '%' || (argv[3] && (!follow || argv[4])))
+    {
+        printf("jobs: usage: jobs [-l | -o %%jobid [-f]]\n");
+        return;
+    }
+    if ((job = getjobjid(&jobs, atoi(argv[2] + 1))) == NULL)
+    {
+        printf("%s: No such job\n", argv[2]);
+        return;
+    }
+    if ((c = job->out) == NULL)
+    {
+        printf("%s: %s\n", argv[2], job->state == PD ? "Job has not started"
+                                                     : "Output not captured");
+        return;
+    }
+    drainoutput(&loop, job);
+    mark = printcapture(c, 0);
+    if (!follow)
+        return;
+    followed = c;
+    loop.intr = 0;
+    while (!c->gone && !loop.intr)
+    {
+        fflush(stdout);
+        runevents(&loop, 0);
+        mark = printcapture(c, mark);
+    }
+    followed = NULL;
+    if (c->gone)
+        freecapture(c);
+}
+
+/*
+ * do_bgfgkl - Execute the builtin bg, fg and kill commands
+ */
+void do_bgfgkl(char **argv)
+{
+    if (!strcmp(argv[0], "bg"))
+    {
+        if (!argv[1])
+        {
+            printf("bg command requires PID or %%jobid argument\n");
+        }
+        else if (!(atoi(argv[1] + 1)))
+        {
+            printf("bg: argument must be a PID or %%jobid\n");
+        }
+        else if (argv[1][0] != '%')
+        {
+            printf("(%s): No such process\n", argv[1]);
+        }
+        else
+        {
+            struct job_t *ptr = getjobjid(&jobs, atoi(++argv[1]));
+            if (ptr != NULL && ptr->state == PD)
+            {
+                printf("%%%s: Job has not started\n", argv[1]);
+            }
+            else if (ptr != NULL)
+            { /*Check if the jobid exists*/
+
+                pid_t pid = ptr->pid;
+                int jid = ptr->jid;
+                char *cmdline = ptr->cmdline;
+                setjobstate(&jobs, ptr, BG); /*Set the state of the process to bg*/
+                signaljob(ptr, SIGCONT);     /*Send signal to continue*/
+
+                printf("[%d] (%d) %s", jid, pid, cmdline);
+            }
+            else
+            {
+                printf("%%%s: No such job\n", argv[1]);
+            }
+        }
+    }
+    else if (!strcmp(argv[0], "fg"))
+    {
+        if (!argv[1])
+        {
+            printf("fg command requires PID or %%jobid argument\n");
+        }
+        else if (!(atoi(argv[1] + 1)))
+        {
+            printf("fg: argument must be a PID or %%jobid\n");
+        }
+        else if (argv[1][0] != '%')
+        {
+            printf("(%s): No such process\n", argv[1]);
+        }
+        else
+        {
+            struct job_t *ptr = getjobjid(&jobs, atoi(++argv[1]));
+            if (ptr != NULL && ptr->state == PD)
+            {
+                printf("%%%s: Job has not started\n", argv[1]);
+            }
+            else if (ptr != NULL)
+            {
+
+                pid_t pid = ptr->pid;
+                setjobstate(&jobs, ptr, FG); /*mark it FG before it can be reaped*/
+                signaljob(ptr, SIGCONT);
+                waitfg(pid);
+            }
+            else
+            {
+                printf("%%%s: No such job\n", argv[1]);
+            }
+        }
+    }
+    else
+    {
+        struct job_t *ptr = getjobjid(&jobs, atoi(++argv[1]));
+        if (ptr != NULL)
+        {
+            signaljob(ptr, SIGKILL); /*a pending job just won't run*/
+            removejob(&jobs, ptr);   /*deleted before it is reaped*/
+        }
+        else
+        {
+            printf("%s: No such job\n", argv[1]);
+        }
+    }
+    return;
+}
+
+/*
+ * do_export - Execute the builtin export command: set each NAME=value
+ *    in the environment, or list the environment if there are none
+ */
+void do_export(char **argv)
+{
+    char *eq, **envp;
+    int i;
+
+    if (argv[1] == NULL)
+    { /* list the environment */
+        for (envp = buildenv(&shellenv); *envp; envp++)
+            printf("%s\n", *envp);
+        return;
+    }
+    for (i = 1; argv[i]; i++)
+    {
+        if ((eq = strchr(argv[i], '=')) == NULL || eq == argv[i])
+        {
+            printf("export: %s: not NAME=value\n", argv[i]);
+            continue;
+        }
+        setenvvar(&shellenv, argv[i], eq - argv[i], eq + 1);
+        if (eq - argv[i] == 4 && !strncmp(argv[i], "PATH", 4))
+            initcmds(&cmdcache, eq + 1); /*forget where commands were found*/
+    }
+}
+
+/*
+ * do_hash - Execute the builtin hash command
+ *
+ *     hash          list remembered commands and their hit counts
+ *     hash -r       forget all remembered commands
+ *     hash name...  look up and remember each name
+ */
+void do_hash(char **argv)
+{
+    int i;
+
+    if (!argv[1])
+    {
+        listcmds(&cmdcache);
+        return;
+    }
+    if (!strcmp(argv[1], "-r"))
+    {
+        clearcmds(&cmdcache);
+        return;
+    }
+    for (i = 1; argv[i]; i++)
+    {
+        if (strchr(argv[i], '/') || !findcmd(&cmdcache, argv[i]))
+            printf("hash: %s: not found\n", argv[i]);
+        else
+            cmdcache.tab[cmdslot(&cmdcache, argv[i])].hits--; /*looking it up isn't a hit*/
+    }
+}
+
+/*
+ * do_cat - Execute the builtin cat command: copy each file to stdout
+ *     inside the shell, with copyfd(). If stdout is a pipe whose reader
+ *     has gone, the copy stops instead of the shell dying of SIGPIPE.
+ */
+void do_cat(char **argv)
+{
+    sigset_t mask_pipe, mask_prev, pending;
+    struct timespec zero = {0, 0};
+    int i, fd, err;
+
+    fflush(stdout);
+    sigemptyset(&mask_pipe);
+    sigaddset(&mask_pipe, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &mask_pipe, &mask_prev);
+
+    for (i = 1; argv[i]; i++)
+    {
+        if ((fd = open(argv[i], O_RDONLY | O_CLOEXEC)) < 0)
+        {
+            fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(errno));
+            continue;
+        }
+        err = copyfd(fd, STDOUT_FILENO) < 0 ? errno : 0;
+        close(fd);
+        if (err == EPIPE)
+            break; /*no one is reading any more*/
+        if (err)
+            fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(err));
+    }
+
+    sigpending(&pending);
+    if (sigismember(&pending, SIGPIPE))
+        sigtimedwait(&mask_pipe, NULL, &zero); /*consume it while blocked*/
+    sigprocmask(SIG_SETMASK, &mask_prev, NULL);
+}
+
+/*
+ * do_echo - Execute echo in the shell, as coreutils echo does: leading
+ *     words made only of n, e and E are options (-n: no newline, -e:
+ *     interpret backslash escapes, -E: don't).
+ */
+void do_echo(char **argv)
+{
+    int newline = 1, escapes = 0, i, n;
+    char *s;
+
+    for (i = 1; argv[i] && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1))
+            break; /* not an option after all: text */
+        for (s = argv[i] + 1; *s; s++)
+        {
+            if (*s == 'n')
+                newline = 0;
+            else
+                escapes = (*s == 'e');
+        }
+    }
+    for (; argv[i]; i++)
+    {
+        if (!escapes)
+        {
+            fputs(argv[i], stdout);
+        }
+        else
+        {
+            for (s = argv[i]; *s; s++)
+            {
+                if (*s != '\\' || !s[1])
+                    putchar(*s);
+                else if ((n = printesc(s + 1, 1, 1)) < 0)
+                    return; /* \c: stop here, no newline */
+                else
+                    s += n;
+            }
+        }
+        if (argv[i + 1])
+            putchar(' ');
+    }
+    if (newline)
+        putchar('\n');
+}
+
+/*
+ * do_printf - Execute printf in the shell, as coreutils printf does: the
+ *     format is reused until the arguments run out.
+ */
+void do_printf(char **argv)
+{
+    char **args;
+    int used, stop = 0;
+
+    if (argv[1] && !strcmp(argv[1], "--"))
+        argv++;
+    if (argv[1] == NULL)
+    {
+        cmderror("printf: missing operand\n"
+                 "Try 'printf --help' for more information.\n");
+        return;
+    }
+    args = argv + 2;
+    do
+    {
+        used = printformat(argv[1], args, &stop);
+        args += used;
+    } while (used > 0 && *args && !stop);
+    if (*args && !stop)
+        cmderror("printf: warning: ignoring excess arguments, starting with '%s'\n",
+                 *args);
+}
+
+/*
+ * do_test - Execute test (or [) in the shell, as coreutils test does.
+ *     Returns its exit status: 0 true, 1 false, 2 error.
+ */
+int do_test(char **argv)
+{
+    char *name = fastname(argv[0]);
+    int n, pos = 0, r;
+
+    for (n = 0; argv[n + 1]; n++)
+        ;
+    argv++;
+    if (!strcmp(name, "["))
+    {
+        if (n == 0 || strcmp(argv[n - 1], "]"))
+        {
+            cmderror("[: missing ']'\n");
+            return 2;
+        }
+        n--;
+    }
+
+    /* POSIX decides by the number of arguments up to four */
+    switch (n)
+    {
+    case 0:
+        return 1;
+    case 1:
+    case 2:
+    case 3:
+        r = testargs(argv, n);
+        break;
+    case 4:
+        if (!strcmp(argv[0], "!"))
+        {
+            r = testargs(argv + 1, 3);
+            r = r < 0 ? r : !r;
+            break;
+        }
+        if (!strcmp(argv[0], "(") && !strcmp(argv[3], ")"))
+        {
+            r = testargs(argv + 1, 2);
+            break;
+        }
+        /* fall through */
+    default:
+        if ((r = testexpr(argv, &pos, n)) >= 0 && pos < n)
+        {
+            cmderror("test: extra argument '%s'\n", argv[pos]);
+            return 2;
+        }
+    }
+    return r < 0 ? 2 : !r;
+}
+
+/*
+ * do_pwd - Execute pwd in the shell: print the physical working
+ *     directory, or with -L $PWD if it names it and has no . or ..
+ */
+void do_pwd(char **argv)
+{
+    struct stat st_pwd, st_dot;
+    int logical = 0, i;
+    char *s, *pwd;
+
+    for (i = 1; argv[i] && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        if (!strcmp(argv[i], "--"))
+        {
+            i++;
+            break;
+        }
+        for (s = argv[i] + 1; *s; s++)
+        {
+            if (*s != 'L' && *s != 'P')
+            {
+                cmderror("pwd: invalid option -- '%c'\n"
+                         "Try 'pwd --help' for more information.\n", *s);
+                return;
+            }
+            logical = (*s == 'L');
+        }
+    }
+    if (argv[i])
+        cmderror("pwd: ignoring non-option arguments\n");
+
+    if (logical && (pwd = getenvvar(&shellenv, "PWD")) != NULL &&
+        pwd[0] == '/' && !strstr(pwd, "/./") && !strstr(pwd, "/../") &&
+        stat(pwd, &st_pwd) == 0 && stat(".", &st_dot) == 0 &&
+        st_pwd.st_dev == st_dot.st_dev && st_pwd.st_ino == st_dot.st_ino)
+    {
+        printf("%s\n", pwd);
+        return;
+    }
+    if ((pwd = getcwd(NULL, 0)) == NULL)
+    {
+        cmderror("pwd: %s\n", strerror(errno));
+        return;
+    }
+    printf("%s\n", pwd);
+    free(pwd);
+}
+
+/*
+ * do_jtop - Execute the builtin jtop command: every <seconds> (1 by
+ *     default), show the CPU% and RSS of each job since the previous
+ *     sample, <count> times or until ctrl-c. Jobs keep being reaped
+ *     meanwhile, as the samples wait in the event loop.
+ */
+void do_jtop(char **argv)
+{
+    double delay = 1, dt;
+    long count = 0, i;
+    char *end;
+
+    for (i = 1; argv[i]; i += 2)
+    {
+        if (argv[i + 1] && !strcmp(argv[i], "-n"))
+            count = strtol(argv[i + 1], &end, 10);
+        else if (argv[i + 1] && !strcmp(argv[i], "-d"))
+            delay = strtod(argv[i + 1], &end);
+        else
+            end = argv[i];
+        if (*end || count < 0 || !(delay >= 0.001))
+        {
+            printf("usage: jtop [-n count] [-d seconds]\n");
+            return;
+        }
+    }
+
+    takesample(&sampler, &jobs); /* the baseline */
+    loop.intr = loop.expired = 0;
+    settimer(&loop, delay);
+    for (i = 0; (count == 0 || i < count) && !loop.intr;)
+    {
+        runevents(&loop, 0);
+        if (loop.expired)
+        {
+            loop.expired = 0;
+            dt = takesample(&sampler, &jobs);
+            printsample(&sampler, &jobs, dt);
+            fflush(stdout);
+            i++;
+        }
+    }
+    settimer(&loop, 0);
+}
+
+/*
+ * do_parallel - Execute the builtin parallel command: run each line of a
+ *     file, or of stdin, as a background job, with at most <jobs> of
+ *     them running (by default one per CPU the shell may use). A line is
+ *     read only when a slot is free, and the event loop frees one as it
+ *     reaps a job, so the queue can be fed as it goes. Queued jobs start
+ *     silently but are on the job list like any other; a stopped one no
+ *     longer takes a slot. Builtins run in the shell as they come. If
+ *     stdin is the shell's own input, the queue is the rest of it. A
+ *     ctrl-c stops the queue and leaves the running jobs in the
+ *     background.
+ */
+void do_parallel(char **argv)
+{
+    struct reader_t queue, *r = &queue;
+    struct arena_t outer = linearena;
+    struct job_t *job;
+    struct stat st;
+    cpu_set_t set;
+    pid_t *slots, pid;
+    char *line, *end, *buf = NULL;
+    size_t len, cap = 0;
+    long njobs = 0;
+    int i, fd = -1, running = 0, more = 1, oldin = -1;
+
+    if (argv[1] && !strcmp(argv[1], "-j"))
+    {
+        if (argv[2] == NULL || (njobs = strtol(argv[2], &end, 10)) < 1 ||
+            *end || njobs > MAXJID)
+            njobs = -1;
+        argv += 2;
+    }
+    if (njobs < 0 || (argv[1] && argv[2]))
+    {
+        printf("parallel: usage: parallel [-j jobs] [file]\n");
+        return;
+    }
+    if (njobs == 0)
+        njobs = sched_getaffinity(0, sizeof(set), &set) == 0 ? CPU_COUNT(&set) : 1;
+
+    if (argv[1])
+    {
+        if ((fd = open(argv[1], O_RDONLY | O_CLOEXEC)) < 0)
+        {
+            printf("parallel: %s: %s\n", argv[1], strerror(errno));
+            return;
+        }
+    }
+    else if (fstat(STDIN_FILENO, &st) == 0 && st.st_dev == input.dev &&
+             st.st_ino == input.ino)
+        r = &input;
+    else if ((fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0)) < 0)
+    {
+        printf("parallel: stdin: %s\n", strerror(errno));
+        return;
+    }
+    if (r == &queue)
+    {
+        openreader(&queue, fd);
+        if (queue.fd >= 0)
+            oldin = swapinput(&loop, queue.fd); /* nextline() waits on it */
+        else
+            fd = -1; /* mapped, and closed */
+    }
+
+    if ((slots = malloc(njobs * sizeof(pid_t))) == NULL)
+        unix_error("malloc error");
+    linearena = (struct arena_t){NULL, 0, 0, 0}; /* the caller's line is in use */
+    announce = 0;
+    loop.intr = 0;
+    while (!loop.intr)
+    {
+        for (i = 0; i < running;)
+        { /* free the slots of jobs that are done or stopped */
+            job = getjobpid(&jobs, slots[i]);
+            if (job == NULL || job->pid != slots[i] || job->state != BG)
+                slots[i] = slots[--running];
+            else
+                i++;
+        }
+        if (more && running < njobs)
+        {
+            if ((line = nextline(r)) == NULL)
+            {
+                more = 0;
+                continue;
+            }
+            len = strlen(line);
+            while (len > 0 && (unsigned char)line[len - 1] <= ' ')
+                len--;
+            if (len + 4 > cap && (buf = realloc(buf, cap = 2 * len + 4)) == NULL)
+                unix_error("realloc error");
+            memcpy(buf, line, len);
+            strcpy(buf + len, len > 0 && line[len - 1] == '&' ? "\n" : " &\n");
+            if ((pid = eval(buf)) != 0)
+                slots[running++] = pid;
+            continue;
+        }
+        if (running == 0)
+            break;
+        runevents(&loop, 0);
+    }
+    announce = 1;
+    arenareset(&linearena);
+    free(linearena.block);
+    linearena = outer;
+    free(buf);
+    free(slots);
+    if (r == &queue)
+    {
+        if (fd >= 0)
+        {
+            swapinput(&loop, oldin);
+            close(fd);
+        }
+        closereader(&queue);
+    }
+    if (loop.intr)
+        printf("parallel: interrupted, %d jobs left running\n", running);
+}
+
+/*
+ * do_setaffinity - Execute the builtin setaffinity command: move a job
+ *     (all of its processes) onto a list of CPUs, or without one show
+ *     the CPUs its leader may run on.
+ */
+void do_setaffinity(char **argv)
+{
+    struct job_t *job;
+    cpu_set_t set;
+
+    if (argv[1] == NULL || argv[1][0] != '%' || !atoi(argv[1] + 1) ||
+        (argv[2] && (argv[3] || !parsecpus(argv[2], &set))))
+    {
+        printf("setaffinity: usage: setaffinity %%jobid [cpu list]\n");
+        return;
+    }
+    if ((job = getjobjid(&jobs, atoi(argv[1] + 1))) == NULL)
+    {
+        printf("%s: No such job\n", argv[1]);
+        return;
+    }
+    if (job->state == PD)
+    {
+        printf("%s: Job has not started\n", argv[1]);
+        return;
+    }
+    if (argv[2] == NULL)
+    {
+        if (sched_getaffinity(job->pid, sizeof(set), &set) < 0)
+        {
+            printf("%s: %s\n", argv[1], strerror(errno));
+            return;
+        }
+        printf("[%d] (%d) ", job->jid, (int)job->pid);
+        printcpus(&set);
+        printf("\n");
+    }
+    else if (setjobaffinity(job, &set) == 0)
+    {
+        printf("%s: No process could be moved\n", argv[1]);
+    }
+}
+
+/*
+ * do_spread - Execute the builtin spread command: put new background
+ *     jobs on the least loaded CPU (cpu) or NUMA node (node), or leave
+ *     them where the shell is (off). Without an argument, show the mode
+ *     and how many jobs each place has.
+ */
+void do_spread(char **argv)
+{
+    static char *modes[] = {"off", "cpu", "node"};
+    int i, mode;
+
+    if (argv[1] == NULL)
+    {
+        printf("spread %s\n", modes[spread.mode]);
+        for (i = 0; i < spread.nplaces; i++)
+        {
+            printf("%s %d: cpus ", modes[spread.mode], spread.id[i]);
+            printcpus(&spread.sets[i]);
+            printf(", %d jobs\n", spread.load[i]);
+        }
+        return;
+    }
+    for (mode = 0; mode < 3; mode++)
+        if (!strcmp(argv[1], modes[mode]))
+            break;
+    if (mode == 3 || argv[2])
+    {
+        printf("spread: usage: spread [off|cpu|node]\n");
+        return;
+    }
+    if (!setspread(&spread, mode))
+        printf("spread: can't find the online CPUs\n");
+}
+
+/*
+ * do_trace - Execute the builtin trace command: start or stop recording
+ *     lifecycle events, forget them, or dump them as Chrome trace-event
+ *     JSON (for chrome://tracing or Perfetto) or, with -b, in the binary
+ *     form of dumptrace(), to a file or stdout. Without an argument, show
+ *     whether it is on and how many events there are.
+ */
+void do_trace(char **argv)
+{
+    FILE *fp = stdout;
+    uint64_t head = __atomic_load_n(&tring->head, __ATOMIC_ACQUIRE);
+    int binary = 0;
+
+    if (argv[1] == NULL)
+    {
+        printf("trace %s, %llu events (the last %d are kept)\n",
+               tring->on ? "on" : "off", (unsigned long long)head, TRACECAP);
+    }
+    else if (!strcmp(argv[1], "on") && argv[2] == NULL)
+    {
+        __atomic_store_n(&tring->on, 1, __ATOMIC_RELEASE);
+    }
+    else if (!strcmp(argv[1], "off") && argv[2] == NULL)
+    {
+        __atomic_store_n(&tring->on, 0, __ATOMIC_RELEASE);
+    }
+    else if (!strcmp(argv[1], "clear") && argv[2] == NULL)
+    {
+        memset(tring->ev, 0, (head < TRACECAP ? head : TRACECAP) * sizeof(tring->ev[0]));
+        __atomic_store_n(&tring->head, 0, __ATOMIC_RELEASE);
+    }
+    else if (!strcmp(argv[1], "dump"))
+    {
+        if ((binary = argv[2] && !strcmp(argv[2], "-b")) != 0)
+            argv++;
+        if (argv[2] && argv[3])
+        {
+            printf("trace: usage: trace [on|off|clear|dump [-b] [file]]\n");
+            return;
+        }
+        if (argv[2] && (fp = fopen(argv[2], "we")) == NULL)
+        {
+            printf("%s: %s\n", argv[2], strerror(errno));
+            return;
+        }
+        dumptrace(fp, binary);
+        if (fp != stdout)
+            fclose(fp);
+    }
+    else
+    {
+        printf("trace: usage: trace [on|off|clear|dump [-b] [file]]\n");
+    }
+}
+
+/*
+ * do_capture - Execute the builtin capture command: turn the capture of
+ *     the output of background jobs started from now on on or off, or
+ *     say whether it is on.
+ */
+void do_capture(char **argv)
+{
+    if (argv[1] == NULL)
+        printf("capture %s\n", use_capture ? "on" : "off");
+    else if (!strcmp(argv[1], "on") && argv[2] == NULL)
+        use_capture = 1;
+    else if (!strcmp(argv[1], "off") && argv[2] == NULL)
+        use_capture = 0;
+    else
+        printf("capture: usage: capture [on|off]\n");
+}
+
+/*
+ * waitfg - Block until process pid is no longer the foreground process
+ */
+void waitfg(pid_t pid)
+{
+    /* the job is deleted (exit) or leaves FG (stop) when the event loop
+     * hands its SIGCHLD to sigchld_handler; a ctrl-c or ctrl-z that comes
+     * meanwhile is passed on to it */
+    while (fgpid(&jobs) == pid)
+        runevents(&loop, 0);
+    tracepoint(TR_FGDONE, pid, 0, 0);
+    return;
+}
+
+/*****************
+ * Signal handlers
+ *****************/
+
+/*
+ * sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
+ *     a child job terminates (becomes a zombie), or stops because it
+ *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
+ *     available zombie children, but doesn't wait for any other
+ *     currently running children to terminate. Like the other
+ *     handlers, it is called by the event loop in ordinary context.
+ *     When the children have pidfds, their exits are reaped through
+ *     those and this only collects the stops.
+ */
+void sigchld_handler(int sig)
+{
+    struct reap_t batch[REAPBATCH];
+    siginfo_t si;
+    int n;
+
+    if (loop.pidfds)
+    {
+        do
+        {
+            for (n = 0; n < REAPBATCH; n++)
+            {
+                si.si_pid = 0;
+                if (waitid(P_ALL, 0, &si, WSTOPPED | WNOHANG) < 0 || si.si_pid == 0)
+                    break;
+                batch[n].pid = si.si_pid;
+                batch[n].status = W_STOPCODE(si.si_status);
+            }
+            reapjobs(&jobs, batch, n);
+        } while (n == REAPBATCH);
+        return;
+    }
+
+    /* SIGCHLDs coalesce, so one signal may stand for many children:
+     * drain every child that is ready, a batch at a time */
+    do
+    {
+        for (n = 0; n < REAPBATCH; n++)
+        {
+            batch[n].pid = wait4(-1, &batch[n].status, WNOHANG | WUNTRACED, &batch[n].ru);
+            if (batch[n].pid <= 0)
+                break;
+        }
+        if (n < REAPBATCH && batch[n].pid < 0 && errno != ECHILD)
+            unix_error("waitpid error");
+        reapjobs(&jobs, batch, n);
+    } while (n == REAPBATCH);
+}
+
+/*
+ * sigint_handler - The kernel sends a SIGINT to the shell whenver the
+ *    user types ctrl-c at the keyboard.  Catch it and send it along
+ *    to the foreground job.
+ */
+void sigint_handler(int sig)
+{
+    if (jobs.fg)
+    {
+        signaljob(jobs.fg, sig);
+    }
+    return;
+}
+
+/*
+ * sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
+ *     the user types ctrl-z at the keyboard. Catch it and suspend the
+ *     foreground job by sending it a SIGTSTP.
+ */
+void sigtstp_handler(int sig)
+{
+    if (jobs.fg)
+    {
+        signaljob(jobs.fg, sig);
+    }
+    return;
+}
+
+/*********************
+ * End signal handlers
+ *********************/
+
+/************
+ * Event loop
+ ************/
+
+/*
+ * initloop - Block the shell's signals (saving the mask it started with
+ *     in shellmask, for its children) and create the signalfd and the
+ *     epoll set that watches it, and the zygote's socket with -z.
+ *     Children get pidfds if the kernel has them.
+ */
+void initloop(struct evloop_t *ev)
+{
+    struct epoll_event e;
+    int fd;
+
+    sigemptyset(&ev->mask);
+    sigaddset(&ev->mask, SIGCHLD);
+    sigaddset(&ev->mask, SIGINT);
+    sigaddset(&ev->mask, SIGTSTP);
+    sigaddset(&ev->mask, SIGQUIT);
+    if (sigprocmask(SIG_BLOCK, &ev->mask, &shellmask) < 0)
+        unix_error("sigprocmask error");
+    if ((ev->sigfd = signalfd(-1, &ev->mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+        unix_error("signalfd error");
+    if ((ev->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        unix_error("epoll_create1 error");
+    e.events = EPOLLIN;
+    e.data.u64 = ev->sigfd;
+    if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->sigfd, &e) < 0)
+        unix_error("epoll_ctl error");
+    if (zygotefd >= 0)
+    { /* it only answers requests, so readable in between means gone */
+        e.events = EPOLLIN | EPOLLRDHUP;
+        e.data.u64 = zygotefd;
+        if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, zygotefd, &e) < 0)
+            unix_error("epoll_ctl error");
+    }
+    ev->infd = -1;
+    ev->armed = 0;
+    ev->timerfd = -1;
+    if ((fd = pidfd_open(getpid(), 0)) >= 0)
+    { /* Linux 5.3 */
+        ev->pidfds = 1;
+        close(fd);
+    }
+}
+
+/*
+ * watchinput - Add the input fd to the epoll set. Regular files (and
+ *     /dev/null) can't be polled; they are always ready, so infd stays -1
+ *     and runevents() doesn't wait on them.
+ */
+void watchinput(struct evloop_t *ev, int fd)
+{
+    struct epoll_event e;
+
+    e.events = EPOLLIN;
+    e.data.u64 = fd;
+    if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &e) == 0)
+    {
+        ev->infd = fd;
+        ev->armed = 1;
+    }
+    else if (errno != EPERM)
+        unix_error("epoll_ctl error");
+}
+
+/*
+ * swapinput - Stop watching the input and watch fd instead (nothing if
+ *     it is -1). Returns the fd watched before, to swap back to.
+ */
+int swapinput(struct evloop_t *ev, int fd)
+{
+    struct epoll_event e;
+    int old = ev->infd;
+
+    if (ev->infd >= 0 && ev->armed &&
+        epoll_ctl(ev->epfd, EPOLL_CTL_DEL, ev->infd, &e) < 0)
+        unix_error("epoll_ctl error");
+    ev->infd = -1;
+    ev->armed = 0;
+    if (fd >= 0)
+        watchinput(ev, fd);
+    return old;
+}
+
+/*
+ * runevents - Wait for the next events and handle the signals among
+ *     them. With wantinput set, also watch the input and return 1 once it
+ *     is ready (at once if it can't be polled); otherwise return 0 after
+ *     each wakeup, for the caller to check whatever it waits for. The
+ *     capture pipes that are ready are drained on the way.
+ */
+int runevents(struct evloop_t *ev, int wantinput)
+{
+    struct epoll_event e[REAPBATCH], mod;
+    struct reap_t batch[REAPBATCH];
+    struct job_t *job;
+    int i, n, nreaped = 0, ready = 0;
+    uint64_t ticks;
+
+    if (wantinput && ev->infd < 0)
+    {
+        dispatchsignals(ev); /* don't let a stream of input starve them */
+        return 1;
+    }
+    if (ev->infd >= 0 && ev->armed != wantinput)
+    { /* taken out of the set, not just disarmed: a hangup is always
+       * reported */
+        mod.events = EPOLLIN;
+        mod.data.u64 = ev->infd;
+        if (epoll_ctl(ev->epfd, wantinput ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+                      ev->infd, &mod) < 0)
+            unix_error("epoll_ctl error");
+        ev->armed = wantinput;
+    }
+    while ((n = epoll_wait(ev->epfd, e, REAPBATCH, -1)) < 0)
+        if (errno != EINTR)
+            unix_error("epoll_wait error");
+    for (i = 0; i < n; i++)
+    {
+        if (e[i].data.u64 & CAPTURETAG)
+        {
+            if ((job = getjobjid(&jobs, (int)(uint32_t)e[i].data.u64)) && job->out)
+                drainoutput(ev, job);
+        }
+        else if (e[i].data.u64 >> 32)
+            nreaped += reapchild(ev, e[i].data.u64, &batch[nreaped]);
+        else if ((int)e[i].data.u64 == ev->sigfd)
+            dispatchsignals(ev);
+        else if ((int)e[i].data.u64 == ev->timerfd)
+        {
+            if (read(ev->timerfd, &ticks, sizeof(ticks)) == sizeof(ticks))
+                ev->expired += (int)ticks;
+        }
+        else if (zygotefd >= 0 && (int)e[i].data.u64 == zygotefd)
+            forgetzygote(ev);
+        else
+            ready = 1; /* readable, or at its end or in error: read says */
+    }
+    reapjobs(&jobs, batch, nreaped);
+    if (jobs.ready)
+        runready(&jobs);
+    return ready;
+}
+
+/*
+ * dispatchsignals - Read the pending signals from the signalfd and call
+ *     their handlers. A signal sent more than once before we read it is
+ *     read once, as it would be delivered once.
+ */
+void dispatchsignals(struct evloop_t *ev)
+{
+    struct signalfd_siginfo si[SIGBATCH];
+    ssize_t got;
+    int i;
+
+    while ((got = read(ev->sigfd, si, sizeof(si))) > 0)
+    {
+        for (i = 0; i < got / (ssize_t)sizeof(si[0]); i++)
+        {
+            tracepoint(TR_SIGRECV, 0, 0, si[i].ssi_signo);
+            switch (si[i].ssi_signo)
+            {
+            case SIGCHLD:
+                sigchld_handler(SIGCHLD);
+                break;
+            case SIGINT:
+                ev->intr = 1;
+                sigint_handler(SIGINT);
+                break;
+            case SIGTSTP:
+                sigtstp_handler(SIGTSTP);
+                break;
+            case SIGQUIT:
+                sigquit_handler(SIGQUIT);
+                break;
+            }
+        }
+    }
+    if (got < 0 && errno != EAGAIN && errno != EINTR)
+        unix_error("signalfd read error");
+}
+
+/*
+ * watchchild - Add a pidfd for the child pid to the epoll set; returns
+ *     it, or -1. Nothing else reaps our children, so the PID can't have
+ *     been reused yet. If the kernel won't give us one (out of fds), we
+ *     go back to reaping every child with waitpid on SIGCHLD; reapchild()
+ *     then finds the watched ones gone.
+ */
+int watchchild(struct evloop_t *ev, pid_t pid)
+{
+    struct epoll_event e;
+    int fd;
+
+    if (!ev->pidfds)
+        return -1;
+    if ((fd = pidfd_open(pid, 0)) < 0)
+    {
+        ev->pidfds = 0;
+        return -1;
+    }
+    e.events = EPOLLIN; /* readable once the child has exited */
+    e.data.u64 = (uint64_t)fd << 32 | (uint32_t)pid;
+    if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &e) < 0)
+        unix_error("epoll_ctl error");
+    return fd;
+}
+
+/*
+ * reapchild - Reap the exited child of a pidfd event into r, take its
+ *     pidfd out of the set and close it. Returns 1, or 0 if waitpid got
+ *     to it first.
+ *
+ * Closing alone isn't enough: a child forked a moment ago holds the fd
+ * until it execs, and while it does the set keeps reporting the fd. Its
+ * number may by then belong to the pidfd of a newer child, which would
+ * be taken for this one.
+ */
+int reapchild(struct evloop_t *ev, uint64_t data, struct reap_t *r)
+{
+    int fd = (int)(data >> 32), got = 0;
+    pid_t pid = (pid_t)(uint32_t)data;
+    struct job_t *job;
+    siginfo_t si;
+
+    si.si_pid = 0; /* glibc's waitid() has no rusage argument */
+    if (syscall(SYS_waitid, P_PIDFD, fd, &si, WEXITED | WNOHANG, &r->ru) == 0 &&
+        si.si_pid)
+    {
+        r->pid = pid;
+        if (si.si_code == CLD_EXITED)
+            r->status = W_EXITCODE(si.si_status, 0);
+        else /* killed */
+            r->status = si.si_status | (si.si_code == CLD_DUMPED ? WCOREFLAG : 0);
+        got = 1;
+    }
+    if ((job = getjobpid(&jobs, pid)) != NULL && job->pidfd == fd)
+        job->pidfd = -1; /* a pipeline's leader; signaljob() does without */
+    epoll_ctl(ev->epfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    return got;
+}
+
+/*
+ * settimer - Make the timer go off every secs seconds, or stop it if
+ *     secs is 0. The timerfd is made, and added to the set, on first use.
+ */
+void settimer(struct evloop_t *ev, double secs)
+{
+    struct itimerspec its;
+    struct epoll_event e;
+
+    if (ev->timerfd < 0)
+    {
+        if ((ev->timerfd = timerfd_create(CLOCK_MONOTONIC,
+                                          TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+            unix_error("timerfd_create error");
+        e.events = EPOLLIN;
+        e.data.u64 = ev->timerfd;
+        if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->timerfd, &e) < 0)
+            unix_error("epoll_ctl error");
+    }
+    its.it_value.tv_sec = (time_t)secs;
+    its.it_value.tv_nsec = (long)((secs - (time_t)secs) * 1e9);
+    its.it_interval = its.it_value;
+    if (timerfd_settime(ev->timerfd, 0, &its, NULL) < 0)
+        unix_error("timerfd_settime error");
+}
+
+/*
+ * signaljob - Send sig to the process group of a job: through the
+ *     leader's pidfd if it has one, else (no pidfd, or the leader of a
+ *     pipeline is gone) with killpg. The job is still on the list, so
+ *     some stage is unreaped and the group ID can't have been reused. A
+ *     pending job has no group yet.
+ */
+int signaljob(struct job_t *job, int sig)
+{
+    if (job->nprocs == 0)
+    {
+        errno = ESRCH;
+        return -1;
+    }
+    tracepoint(sig == SIGCONT ? TR_CONT : TR_SIGNAL, job->pid, job->jid, sig);
+    if (job->pidfd >= 0 &&
+        pidfd_send_signal(job->pidfd, sig, NULL, PIDFD_SIGNAL_PROCESS_GROUP) == 0)
+        return 0;
+    return killpg(job->pid, sig);
+}
+
+/*
+ * opencapture - Make the pipe for the output of a background job:
+ *     fds[0] for us, non-blocking, and fds[1] for its stages; both
+ *     close-on-exec. Returns 0 (and says why) if it can't.
+ */
+int opencapture(int *fds)
+{
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        printf("capture: %s\n", strerror(errno));
+        fds[0] = fds[1] = -1;
+        return 0;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    return 1;
+}
+
+/*
+ * watchcapture - Give a job the read end fd of its capture pipe, with an
+ *     empty ring, and add it to the epoll set.
+ */
+void watchcapture(struct evloop_t *ev, struct job_t *job, int fd)
+{
+    struct epoll_event e;
+
+    if ((job->out = calloc(1, sizeof(struct capture_t))) == NULL)
+        unix_error("calloc error");
+    job->out->fd = fd;
+    e.events = EPOLLIN;
+    e.data.u64 = CAPTURETAG | (uint32_t)job->jid;
+    if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &e) < 0)
+        unix_error("epoll_ctl error");
+}
+
+/*
+ * drainoutput - Read what is in a job's capture pipe into its ring,
+ *     over the oldest bytes, and pass it on if the job is in the
+ *     foreground. At most CAPTURECAP bytes are read at a time, so a job
+ *     that prints without a pause doesn't keep the loop from the rest;
+ *     the pipe stays ready. At the end of the pipe, it is closed.
+ */
+void drainoutput(struct evloop_t *ev, struct job_t *job)
+{
+    struct capture_t *c = job->out;
+    size_t off, got = 0;
+    ssize_t n = 0;
+
+    if (c->fd < 0)
+        return;
+    if (c->ring == NULL && (c->ring = malloc(CAPTURECAP)) == NULL)
+        unix_error("malloc error");
+    while (got < CAPTURECAP)
+    {
+        off = c->total & (CAPTURECAP - 1);
+        if ((n = read(c->fd, c->ring + off, CAPTURECAP - off)) < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        if (job->state == FG)
+        { /* after what we printed ourselves */
+            fflush(stdout);
+            writeall(STDOUT_FILENO, c->ring + off, n);
+        }
+        c->total += n;
+        got += n;
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN))
+    {
+        epoll_ctl(ev->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+        if (c->total == 0)
+        { /* it printed nothing */
+            free(c->ring);
+            c->ring = NULL;
+        }
+    }
+}
+
+/*
+ * endcapture - The job is going: take in what is left in its pipe (what
+ *     its stages' children print later is lost), close it and free the
+ *     ring, unless jobs -o -f has yet to show it.
+ */
+void endcapture(struct evloop_t *ev, struct job_t *job)
+{
+    struct capture_t *c = job->out;
+
+    drainoutput(ev, job);
+    if (c->fd >= 0)
+    {
+        epoll_ctl(ev->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+    }
+    job->out = NULL;
+    if (c == followed)
+        c->gone = 1;
+    else
+        freecapture(c);
+}
+
+/* freecapture - Free a capture ring */
+void freecapture(struct capture_t *c)
+{
+    free(c->ring);
+    free(c);
+}
+
+/*
+ * printcapture - Print the captured bytes from byte from on (counted
+ *     from the job's first) that are still in the ring, saying how many
+ *     before them have been overwritten. Returns where it got to.
+ */
+uint64_t printcapture(struct capture_t *c, uint64_t from)
+{
+    uint64_t first = c->total > CAPTURECAP ? c->total - CAPTURECAP : 0;
+    size_t off, len;
+
+    if (from < first)
+    {
+        printf("[%llu bytes dropped]\n", (unsigned long long)(first - from));
+        from = first;
+    }
+    while (from < c->total)
+    {
+        off = from & (CAPTURECAP - 1);
+        len = CAPTURECAP - off;
+        if (len > c->total - from)
+            len = c->total - from;
+        fwrite(c->ring + off, 1, len, stdout);
+        from += len;
+    }
+    return from;
+}
+
+/*****************
+ * End event loop
+ *****************/
+
+/***********************************************
+ * Helper routines that manipulate the job list
+ **********************************************/
+
+/* clearjob - Clear the entries in a job struct */
+void clearjob(struct job_t *job)
+{
+    job->pid = 0;
+    job->jid = 0;
+    job->state = UNDEF;
+    job->nprocs = job->live = 0;
+    job->termsig = 0;
+    job->status = -1;
+    job->pids = NULL;
+    job->pidfd = -1;
+    job->place = -1;
+    job->after = NULL;
+    job->nafter = job->waiting = 0;
+    job->words = NULL;
+    job->wordslen = 0;
+    job->cmdline = NULL;
+    job->out = NULL;
+}
+
+/* initjobs - Initialize the job list */
+void initjobs(struct joblist_t *jl)
+{
+    memset(jl, 0, sizeof(*jl));
+    jl->jidcap = MAXJOBS + 1;
+    jl->pidcap = 2 * MAXJOBS;
+    if ((jl->byjid = calloc(jl->jidcap, sizeof(struct job_t *))) == NULL ||
+        (jl->fate = calloc(jl->jidcap, 1)) == NULL ||
+        (jl->bypid = calloc(jl->pidcap, sizeof(struct pident_t))) == NULL)
+        unix_error("initjobs error");
+}
+
+/* maxjid - Returns largest allocated job ID */
+int maxjid(struct joblist_t *jl)
+{
+    return jl->maxjid;
+}
+
+/* pidhash - Home slot of pid in the PID hash */
+int pidhash(struct joblist_t *jl, pid_t pid)
+{
+    return (int)(((unsigned)pid * 2654435761u) & (jl->pidcap - 1));
+}
+
+/* pidslot - Slot of pid in the PID hash, or the empty slot where it
+ *     would go */
+int pidslot(struct joblist_t *jl, pid_t pid)
+{
+    int i = pidhash(jl, pid);
+
+    while (jl->bypid[i].jid && jl->bypid[i].pid != pid)
+        i = (i + 1) & (jl->pidcap - 1);
+    return i;
+}
+
+/* unhashpid - Remove pid from the PID hash if it belongs to job jid */
+void unhashpid(struct joblist_t *jl, pid_t pid, int jid)
+{
+    int i, j, k, mask = jl->pidcap - 1;
+
+    i = pidslot(jl, pid);
+    if (jl->bypid[i].jid != jid)
+        return;
+
+    /* backward-shift deletion: pull later entries of the probe run into
+     * the hole so lookups never need tombstones */
+    for (j = (i + 1) & mask; jl->bypid[j].jid; j = (j + 1) & mask)
+    {
+        k = pidhash(jl, jl->bypid[j].pid);
+        if (((j - k) & mask) >= ((j - i) & mask))
+        { /* home slot k is not in (i, j], so the entry may move to i */
+            jl->bypid[i] = jl->bypid[j];
+            i = j;
+        }
+    }
+    jl->bypid[i].jid = 0;
+    jl->nprocs--;
+    jl->gen++;
+}
+
+/* growjobs - Make room for one more job of nprocs stages; returns 0 if
+ *     out of memory */
+int growjobs(struct joblist_t *jl, int nprocs)
+{
+    int i, oldcap;
+    struct job_t **byjid;
+    struct pident_t *bypid, *old;
+    char *fate;
+
+    if (jl->maxjid + 1 >= jl->jidcap)
+    {
+        if ((byjid = realloc(jl->byjid, 2 * jl->jidcap * sizeof(*byjid))) == NULL)
+            return 0;
+        memset(byjid + jl->jidcap, 0, jl->jidcap * sizeof(*byjid));
+        jl->byjid = byjid;
+        if ((fate = realloc(jl->fate, 2 * jl->jidcap)) == NULL)
+            return 0;
+        memset(fate + jl->jidcap, 0, jl->jidcap);
+        jl->fate = fate;
+        jl->jidcap *= 2;
+    }
+    while (2 * (jl->nprocs + nprocs) > jl->pidcap)
+    { /* keep the PID hash at most half full, then rehash */
+        if ((bypid = calloc(2 * jl->pidcap, sizeof(struct pident_t))) == NULL)
+            return 0;
+        old = jl->bypid;
+        oldcap = jl->pidcap;
+        jl->bypid = bypid;
+        jl->pidcap *= 2;
+        for (i = 0; i < oldcap; i++)
+            if (old[i].jid)
+                jl->bypid[pidslot(jl, old[i].pid)] = old[i];
+        free(old);
+    }
+    if (jl->free == NULL)
+    { /* records come in chunks so the live ones stay packed */
+        struct job_t *chunk = malloc(JOBCHUNK * sizeof(struct job_t));
+        int i;
+
+        if (chunk == NULL)
+            return 0;
+        for (i = 0; i < JOBCHUNK; i++)
+        {
+            chunk[i].next = jl->free;
+            jl->free = &chunk[i];
+        }
+    }
+    return 1;
+}
+
+/* addjob - Add a job to the job list */
+int addjob(struct joblist_t *jl, pid_t pid, int state, char *cmdline)
+{
+    return addpipejob(jl, &pid, 1, state, cmdline);
+}
+
+/* addpipejob - Add a job whose n stages have PIDs pids[0..n-1] (pids[0]
+ *     is the process group leader) to the job list */
+int addpipejob(struct joblist_t *jl, pid_t *pids, int n, int state, char *cmdline)
+{
+    struct job_t *job;
+
+    if (n < 1 || pids[0] < 1)
+        return 0;
+
+    if ((job = newjob(jl, state, cmdline)) == NULL)
+        return 0;
+    if (!setjobprocs(jl, job, pids, n, state))
+    {
+        removejob(jl, job);
+        printf("Tried to create too many jobs\n");
+        return 0;
+    }
+    if (verbose)
+    {
+        printf("Added job [%d] %d %s\n", job->jid, job->pid, job->cmdline);
+    }
+    return 1;
+}
+
+/* newjob - Put a job with no processes yet on the job list, with the
+ *     next JID; NULL if there is no room */
+struct job_t *newjob(struct joblist_t *jl, int state, char *cmdline)
+{
+    struct job_t *job;
+
+    if (jl->maxjid + 1 > MAXJID || !growjobs(jl, 0) ||
+        (cmdline = pooldup(&strpool, cmdline)) == NULL)
+    {
+        printf("Tried to create too many jobs\n");
+        return NULL;
+    }
+    job = jl->free;
+    jl->free = job->next;
+
+    clearjob(job);
+    job->state = state;
+    job->jid = ++jl->maxjid;
+    job->pids = &job->pid;
+    job->cmdline = cmdline;
+    memset(&job->stats, 0, sizeof(job->stats));
+    jl->byjid[job->jid] = job;
+    if (jl->maxfate >= job->jid)
+    { /* the numbering has started over below them: the fates from
+       * there on are of jobs whose JIDs are about to be reused */
+        memset(jl->fate + job->jid, FATE_NONE, jl->maxfate - job->jid + 1);
+        jl->maxfate = job->jid - 1;
+    }
+    jl->count++;
+    jl->gen++;
+    return job;
+}
+
+/* setjobprocs - Give a job on the list (new, or pending until now) its
+ *     n stages, and a new state; returns 0 if there is no room */
+int setjobprocs(struct joblist_t *jl, struct job_t *job, pid_t *pids, int n,
+                int state)
+{
+    pid_t *stages = NULL;
+    int i;
+
+    if (!growjobs(jl, n) ||
+        (n > 1 && (stages = poolalloc(&strpool, n * sizeof(pid_t))) == NULL))
+        return 0;
+    job->pid = pids[0];
+    job->nprocs = job->live = n;
+    job->pids = stages ? stages : &job->pid;
+    for (i = 0; i < n; i++)
+    {
+        job->pids[i] = pids[i];
+        jl->bypid[pidslot(jl, pids[i])] = (struct pident_t){pids[i], job->jid};
+    }
+    jl->nprocs += n;
+    jl->gen++;
+    setjobstate(jl, job, state);
+    return 1;
+}
+
+/* deletejob - Delete the job that has a process with PID=pid from the
+ *     job list, along with all of its stages */
+int deletejob(struct joblist_t *jl, pid_t pid)
+{
+    struct job_t *job;
+
+    if ((job = getjobpid(jl, pid)) == NULL)
+        return 0;
+    removejob(jl, job);
+    return 1;
+}
+
+/*
+ * removejob - Take a job off the job list and note how it ended: well if
+ *     its last stage exited with 0, badly if not or if it is removed
+ *     before that (kill, or a pending job that won't run). The pending
+ *     jobs that wait for it are then told.
+ */
+void removejob(struct joblist_t *jl, struct job_t *job)
+{
+    int i, jid = job->jid, ok = job->status == 0;
+
+    for (i = 0; i < job->nprocs; i++)
+        unhashpid(jl, job->pids[i], job->jid); /* the reaped ones are gone */
+    if (job->pids != &job->pid)
+        poolrelease(&strpool, job->pids, job->nprocs * sizeof(pid_t));
+    if (job->after)
+        poolrelease(&strpool, job->after, job->nafter * sizeof(int));
+    if (job->words)
+        poolrelease(&strpool, job->words, job->wordslen);
+
+    jl->byjid[job->jid] = NULL;
+    jl->fate[job->jid] = ok ? FATE_OK : FATE_FAILED;
+    if (job->jid > jl->maxfate)
+        jl->maxfate = job->jid;
+    while (jl->maxjid > 0 && jl->byjid[jl->maxjid] == NULL)
+        jl->maxjid--; /* next job gets max JID + 1 */
+    jl->count--;
+    jl->gen++;
+    if (jl->fg == job)
+        jl->fg = NULL;
+    if (job->place >= 0 && job->place < spread.nplaces)
+        spread.load[job->place]--;
+    if (job->out)
+        endcapture(&loop, job);
+    poolfree(&strpool, job->cmdline);
+    clearjob(job);
+    job->next = jl->free;
+    jl->free = job;
+    resolveafter(jl, jid, ok);
+}
+
+/*
+ * deferjob - Put a job on the list that is to run after the jobs named
+ *     in argv ("%1 %2 -- command"), pending. A job that is gone counts
+ *     as it ended, if no other has had its JID, or a lower one once the
+ *     numbering started over, since. The words of the command are kept
+ *     as they are now, $VARs expanded, for takewords(). Returns NULL
+ *     (and says why) if the job can't be made or would never run.
+ */
+struct job_t *deferjob(struct joblist_t *jl, char **argv, char *cmdline)
+{
+    struct job_t *job;
+    int i, k, n, jid, *after;
+    size_t len;
+    char *words, *p;
+
+    for (n = 0; argv[n] && strcmp(argv[n], "--"); n++)
+    {
+        if (argv[n][0] != '%' || atoi(argv[n] + 1) < 1)
+            break;
+    }
+    if (n == 0 || argv[n] == NULL || strcmp(argv[n], "--") || argv[n + 1] == NULL)
+    {
+        printf("after: usage: after %%jobid... -- command\n");
+        return NULL;
+    }
+    for (i = 0; i < n; i++)
+    {
+        jid = atoi(argv[i] + 1);
+        if (getjobjid(jl, jid) != NULL)
+            continue;
+        if (jid < jl->jidcap && jl->fate[jid] == FATE_FAILED)
+        {
+            printf("after: %s failed\n", argv[i]);
+            return NULL;
+        }
+        if (jid >= jl->jidcap || jl->fate[jid] == FATE_NONE)
+        {
+            printf("after: %s: No such job\n", argv[i]);
+            return NULL;
+        }
+    }
+
+    for (len = 0, i = n + 1; argv[i]; i++)
+        len += strlen(argv[i]) + 1;
+    if ((job = newjob(jl, PD, cmdline)) == NULL)
+        return NULL;
+    if ((after = poolalloc(&strpool, n * sizeof(int))) == NULL ||
+        (words = poolalloc(&strpool, len)) == NULL)
+    {
+        if (after)
+            poolrelease(&strpool, after, n * sizeof(int));
+        removejob(jl, job);
+        printf("Tried to create too many jobs\n");
+        return NULL;
+    }
+    for (p = words, i = n + 1; argv[i]; i++)
+        p = stpcpy(p, argv[i]) + 1;
+    job->words = words;
+    job->wordslen = len;
+    for (i = 0; i < n; i++)
+    {
+        after[i] = 0;
+        jid = atoi(argv[i] + 1);
+        if (getjobjid(jl, jid) == NULL || jid == job->jid)
+            continue; /* done already */
+        for (k = 0; k < job->waiting && after[k] != jid; k++)
+            ;
+        if (k == job->waiting)
+            after[job->waiting++] = jid;
+    }
+    job->after = after;
+    job->nafter = n;
+    if (job->waiting == 0)
+        jl->ready++;
+    return job;
+}
+
+/*
+ * takewords - Copy the words deferjob() kept for a pending job into the
+ *     arena a as w, and give its cell back to the pool: they are only
+ *     needed to start the job.
+ */
+void takewords(struct job_t *job, struct arena_t *a, struct words_t *w)
+{
+    int cap = ARGVMIN; /* slots in w->argv */
+    char *p, *end;
+
+    w->argv = arenaalloc(a, cap * sizeof(char *));
+    w->argv[0] = NULL;
+    w->argc = 0;
+    if (job->words == NULL)
+        return;
+    p = memcpy(arenaalloc(a, job->wordslen), job->words, job->wordslen);
+    for (end = p + job->wordslen; p < end; p += strlen(p) + 1)
+        addword(a, w, &cap, p);
+    poolrelease(&strpool, job->words, job->wordslen);
+    job->words = NULL;
+    job->wordslen = 0;
+}
+
+/*
+ * resolveafter - Check job jid off the pending jobs that wait for it:
+ *     if it failed, they won't run; if it was the last one a job waited
+ *     for, that job is ready to start.
+ */
+void resolveafter(struct joblist_t *jl, int jid, int ok)
+{
+    struct job_t *job;
+    int i, k;
+
+    for (k = 1; k <= jl->maxjid; k++)
+    {
+        if ((job = jl->byjid[k]) == NULL || job->state != PD)
+            continue;
+        for (i = 0; i < job->nafter && job->after[i] != jid; i++)
+            ;
+        if (i == job->nafter)
+            continue;
+        job->after[i] = 0;
+        if (!ok)
+        {
+            printf("Job [%d] not run: job [%d] failed\n", job->jid, jid);
+            removejob(jl, job); /* and its own dependents */
+        }
+        else if (--job->waiting == 0)
+            jl->ready++;
+    }
+}
+
+/* waitingjobs - True if there are pending jobs and running jobs that
+ *     they may be waiting for. A stopped job doesn't count: it won't
+ *     end by itself, so what waits for it stays pending (stoppedafter()
+ *     says so) */
+int waitingjobs(struct joblist_t *jl)
+{
+    int k, pending = 0, running = 0;
+
+    for (k = 1; k <= jl->maxjid; k++)
+    {
+        if (jl->byjid[k] == NULL)
+            continue;
+        pending |= jl->byjid[k]->state == PD;
+        running |= jl->byjid[k]->state == BG;
+    }
+    return pending && running;
+}
+
+/* stoppedafter - The JID of a stopped job that the pending job waits
+ *     for, or 0 if none is stopped */
+int stoppedafter(struct joblist_t *jl, struct job_t *job)
+{
+    struct job_t *dep;
+    int i;
+
+    for (i = 0; i < job->nafter; i++)
+        if ((dep = getjobjid(jl, job->after[i])) != NULL && dep->state == ST)
+            return dep->jid;
+    return 0;
+}
+
+/*
+ * runready - Start the pending jobs whose wait is over. It is called
+ *     from the event loop, maybe while eval() waits for a foreground
+ *     job, so the lines are parsed in a line arena of their own.
+ */
+void runready(struct joblist_t *jl)
+{
+    struct arena_t outer = linearena;
+    struct job_t *job;
+    int k;
+
+    linearena = (struct arena_t){NULL, 0, 0, 0};
+    while (jl->ready > 0)
+    { /* a job that is a builtin is done at once, and may make more */
+        jl->ready = 0;
+        for (k = 1; k <= jl->maxjid; k++)
+        {
+            if ((job = jl->byjid[k]) == NULL || job->state != PD ||
+                job->waiting > 0)
+                continue;
+            evaljob(job->cmdline, job);
+            if (jl->byjid[k] == job && job->state == PD)
+                removejob(jl, job); /* it could not be started */
+        }
+    }
+    arenareset(&linearena);
+    free(linearena.block);
+    linearena = outer;
+}
+
+/* setjobstate - Move a job to a new state, tracking the FG job */
+void setjobstate(struct joblist_t *jl, struct job_t *job, int state)
+{
+    job->state = state;
+    if (state == FG)
+        jl->fg = job;
+    else if (jl->fg == job)
+        jl->fg = NULL;
+}
+
+/* reapjobs - Apply a batch of waitpid results to the job list */
+void reapjobs(struct joblist_t *jl, struct reap_t *batch, int n)
+{
+    int i;
+    struct job_t *job;
+    struct timespec now = {0, 0};
+
+    for (i = 0; i < n; i++)
+    {
+        job = getjobpid(jl, batch[i].pid);
+        tracepoint(WIFSTOPPED(batch[i].status) ? TR_STOP : TR_REAP, batch[i].pid,
+                   job ? job->jid : 0, WIFSTOPPED(batch[i].status)
+                                           ? WSTOPSIG(batch[i].status)
+                                           : batch[i].status);
+        /* the kill builtin deletes its victim before it is reaped */
+        if (job == NULL)
+            continue;
+        if (WIFSTOPPED(batch[i].status))
+        {
+            if (job->state == ST)
+                continue; /* another stage of a job already reported */
+            setjobstate(jl, job, ST);
+            printf("Job [%d] (%d) stopped by signal %d\n",
+                   job->jid, job->pid, WSTOPSIG(batch[i].status));
+        }
+        else
+        {
+            /* like its exit status, a pipeline's fate is its last stage's
+             * (a writer killed by SIGPIPE is not news); if that one
+             * couldn't be started, the job already has its status */
+            if (batch[i].pid == job->pids[job->nprocs - 1] && job->status == -1)
+            {
+                job->status = batch[i].status;
+                if (WIFSIGNALED(batch[i].status))
+                    job->termsig = WTERMSIG(batch[i].status);
+            }
+            addusage(&job->stats, &batch[i].ru);
+            if (--job->live > 0)
+            { /* the job is done when its last stage is */
+                unhashpid(jl, batch[i].pid, job->jid);
+                continue;
+            }
+            if (now.tv_sec == 0)
+                clock_gettime(CLOCK_MONOTONIC, &now);
+            job->stats.exited = now;
+            jl->last = job->stats;
+            jl->lastpid = job->pid;
+            if (job->termsig)
+                printf("Job [%d] (%d) terminated by signal %d\n",
+                       job->jid, job->pid, job->termsig);
+            deletejob(jl, batch[i].pid);
+        }
+    }
+}
+
+/* fgpid - Return PID of current foreground job, 0 if no such job */
+pid_t fgpid(struct joblist_t *jl)
+{
+    return jl->fg ? jl->fg->pid : 0;
+}
+
+/* getjobpid  - Find a job (by PID) on the job list */
+struct job_t *getjobpid(struct joblist_t *jl, pid_t pid)
+{
+    int jid;
+
+    if (pid < 1)
+        return NULL;
+
+    jid = jl->bypid[pidslot(jl, pid)].jid;
+    return jid ? jl->byjid[jid] : NULL;
+}
+
+/* getjobjid  - Find a job (by JID) on the job list */
+struct job_t *getjobjid(struct joblist_t *jl, int jid)
+{
+    if (jid < 1 || jid > jl->maxjid)
+        return NULL;
+
+    return jl->byjid[jid];
+}
+
+/* pid2jid - Map process ID to job ID */
+int pid2jid(pid_t pid)
+{
+    struct job_t *job = getjobpid(&jobs, pid);
+
+    return job ? job->jid : 0;
+}
+
+/* listjobs - Print the job list; with usage, each job's resource use
+ *     so far under it */
+void listjobs(struct joblist_t *jl, int usage)
+{
+    int i, jid;
+    struct job_t *job;
+    struct jobstats_t st;
+
+    for (jid = 1; jid <= jl->maxjid; jid++)
+    {
+        if ((job = jl->byjid[jid]) != NULL)
+        {
+            if (job->state == PD)
+            { /* no processes, and nothing used yet */
+                if ((i = stoppedafter(jl, job)) != 0)
+                    printf("[%d] (-) Pending on stopped job [%d] %s",
+                           job->jid, i, job->cmdline);
+                else
+                    printf("[%d] (-) Pending %s", job->jid, job->cmdline);
+                continue;
+            }
+            printf("[%d] (%d) ", job->jid, job->pid);
+            switch (job->state)
+            {
+            case BG:
+                printf("Running ");
+                break;
+            case FG:
+                printf("Foreground ");
+                break;
+            case ST:
+                printf("Stopped ");
+                break;
+            default:
+                printf("listjobs: Internal error: job[%d].state=%d ",
+                       jid, job->state);
+            }
+            printf("%s", job->cmdline);
+            if (!usage)
+                continue;
+            st = job->stats;
+            for (i = 0; i < job->nprocs; i++)
+                if (getjobpid(jl, job->pids[i]) == job)
+                    procusage(job->pids[i], &st); /* not reaped yet */
+            clock_gettime(CLOCK_MONOTONIC, &st.exited);
+            printf("    wall %.3fs user %.3fs sys %.3fs maxrss %ldKB "
+                   "ctxsw %ld/%ld launch %.0fus\n",
+                   elapsed(&st.forked, &st.exited),
+                   st.utime.tv_sec + st.utime.tv_usec / 1e6,
+                   st.stime.tv_sec + st.stime.tv_usec / 1e6, st.maxrss,
+                   st.nvcsw, st.nivcsw, elapsed(&st.forked, &st.execd) * 1e6);
+        }
+    }
+}
+
+/* addusage - Add the rusage of a reaped stage to a job's */
+void addusage(struct jobstats_t *st, struct rusage *ru)
+{
+    timeradd(&st->utime, &ru->ru_utime, &st->utime);
+    timeradd(&st->stime, &ru->ru_stime, &st->stime);
+    if (ru->ru_maxrss > st->maxrss)
+        st->maxrss = ru->ru_maxrss;
+    st->nvcsw += ru->ru_nvcsw;
+    st->nivcsw += ru->ru_nivcsw;
+}
+
+/*
+ * procusage - Add what a running process has used so far, from /proc,
+ *     to st. Only jobs -l asks, so the cost stays off the launch and
+ *     reap paths.
+ */
+void procusage(pid_t pid, struct jobstats_t *st)
+{
+    char path[64], buf[4096], *p;
+    unsigned long long utime, stime;
+    long hz = sysconf(_SC_CLK_TCK), val;
+    pid_t pgrp;
+    struct rusage ru;
+    ssize_t n;
+    int fd;
+
+    memset(&ru, 0, sizeof(ru));
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    buf[n > 0 ? n : 0] = '\0';
+    if (!parsestat(buf, &pgrp, &utime, &stime))
+        return;
+    ru.ru_utime.tv_sec = utime / hz;
+    ru.ru_utime.tv_usec = utime % hz * (1000000 / hz);
+    ru.ru_stime.tv_sec = stime / hz;
+    ru.ru_stime.tv_usec = stime % hz * (1000000 / hz);
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0)
+    {
+        n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        buf[n > 0 ? n : 0] = '\0';
+        for (p = buf; p != NULL;)
+        {
+            if (sscanf(p, "VmHWM: %ld", &val) == 1)
+                ru.ru_maxrss = val;
+            else if (sscanf(p, "voluntary_ctxt_switches: %ld", &val) == 1)
+                ru.ru_nvcsw = val;
+            else if (sscanf(p, "nonvoluntary_ctxt_switches: %ld", &val) == 1)
+                ru.ru_nivcsw = val;
+            if ((p = strchr(p, '\n')) != NULL)
+                p++;
+        }
+    }
+    addusage(st, &ru);
+}
+
+/*
+ * parsestat - Get the process group and CPU ticks out of the text of a
+ *     /proc/<pid>/stat; returns 0 if it doesn't parse
+ */
+int parsestat(const char *buf, pid_t *pgrp, unsigned long long *utime,
+              unsigned long long *stime)
+{
+    const char *p;
+    char *end;
+    int field;
+
+    /* pid (comm) state ppid pgrp ... utime is field 14; comm may hold
+     * anything, so look for the last ')'. jtop parses a lot of these,
+     * hence no sscanf. */
+    if ((p = strrchr(buf, ')')) == NULL || p[1] != ' ')
+        return 0;
+    for (field = 3, p += 2; field < 14; field++)
+    {
+        if (field == 5)
+            *pgrp = (pid_t)strtol(p, NULL, 10);
+        if ((p = strchr(p, ' ')) == NULL)
+            return 0;
+        p++;
+    }
+    *utime = strtoull(p, &end, 10);
+    if (*end != ' ')
+        return 0;
+    *stime = strtoull(end + 1, &end, 10);
+    return *end == ' ';
+}
+
+/* printtimes - Report a timed command's use on stderr, as bash does */
+void printtimes(struct jobstats_t *st)
+{
+    double real = elapsed(&st->forked, &st->exited);
+
+    fflush(stdout);
+    fprintf(stderr, "\nreal\t%dm%.3fs\nuser\t%dm%.3fs\nsys\t%dm%.3fs\n",
+            (int)(real / 60), real - 60 * (int)(real / 60),
+            (int)(st->utime.tv_sec / 60),
+            st->utime.tv_sec % 60 + st->utime.tv_usec / 1e6,
+            (int)(st->stime.tv_sec / 60),
+            st->stime.tv_sec % 60 + st->stime.tv_usec / 1e6);
+    fprintf(stderr, "maxrss\t%ldKB\nctxsw\t%ld voluntary, %ld involuntary\n",
+            st->maxrss, st->nvcsw, st->nivcsw);
+}
+
+/* elapsed - Seconds from one monotonic time to another */
+double elapsed(struct timespec *from, struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/* poolclass - Size class of a cell of size bytes */
+int poolclass(size_t size)
+{
+    int cls = 0;
+
+    while ((size_t)(POOLMIN << cls) < size)
+        cls++;
+    return cls;
+}
+
+/* poolalloc - Get a cell of at least size bytes from the pool, NULL if
+ *     out of memory */
+void *poolalloc(struct strpool_t *sp, size_t size)
+{
+    int cls = poolclass(size);
+    char *cell;
+
+    size = (size_t)POOLMIN << cls;
+    if ((cell = sp->free[cls]) != NULL)
+    {
+        memcpy(&sp->free[cls], cell, sizeof(char *));
+    }
+    else if (size > POOLBLOCK / 4)
+    { /* big cells would waste most of a block */
+        if ((cell = malloc(size)) == NULL)
+            return NULL;
+    }
+    else
+    {
+        if (sp->left < size)
+        {
+            if ((sp->block = malloc(POOLBLOCK)) == NULL)
+                return NULL;
+            sp->left = POOLBLOCK;
+        }
+        cell = sp->block;
+        sp->block += size;
+        sp->left -= size;
+    }
+    return cell;
+}
+
+/* poolrelease - Return a cell of size bytes to the pool
+ *     (async-signal-safe) */
+void poolrelease(struct strpool_t *sp, void *cell, size_t size)
+{
+    int cls = poolclass(size);
+
+    memcpy(cell, &sp->free[cls], sizeof(char *));
+    sp->free[cls] = cell;
+}
+
+/* pooldup - Copy str into the string pool, NULL if out of memory */
+char *pooldup(struct strpool_t *sp, const char *str)
+{
+    size_t len = strlen(str);
+    char *cell;
+
+    if ((cell = poolalloc(sp, len + 1)) != NULL)
+        memcpy(cell, str, len + 1);
+    return cell;
+}
+
+/* poolfree - Return a string to the pool (async-signal-safe) */
+void poolfree(struct strpool_t *sp, char *str)
+{
+    poolrelease(sp, str, strlen(str) + 1);
+}
+/******************************
+ * end job list helper routines
+ ******************************/
+
+/*************************************
+ * Helper routines of the job sampler
+ *************************************/
+
+/*
+ * rebuildsampler - Find the processes of every job again: its live
+ *     stages, then their children (from /proc/<pid>/task/<pid>/children)
+ *     that are still in the job's process group, and theirs. The fds of
+ *     processes the sampler already had are kept, the others closed.
+ */
+void rebuildsampler(struct sampler_t *sp, struct joblist_t *jl)
+{
+    struct procstat_t *procs = NULL;
+    char path[64], buf[4096], *s, *end;
+    int n = 0, cap = 0, i, j, k, fd;
+    struct job_t *job;
+    ssize_t got;
+    long child;
+
+    for (i = 0; i < sp->n; i++)
+        sp->procs[i].jid = 0; /* not claimed yet */
+    for (k = 1; k <= jl->maxjid; k++)
+    {
+        if ((job = jl->byjid[k]) == NULL)
+            continue;
+        i = n;
+        for (j = 0; j < job->nprocs; j++)
+            if (getjobpid(jl, job->pids[j]) == job)
+                addproc(&procs, &n, &cap, job->pids[j], job->jid, 0, sp);
+        for (; i < n; i++)
+        { /* n grows as we go: breadth first through the descendants */
+            snprintf(path, sizeof(path), "/proc/%d/task/%d/children",
+                     (int)procs[i].pid, (int)procs[i].pid);
+            if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+                continue;
+            got = read(fd, buf, sizeof(buf) - 1);
+            close(fd);
+            buf[got > 0 ? got : 0] = '\0';
+            for (s = buf; (child = strtol(s, &end, 10)) > 0; s = end)
+                addproc(&procs, &n, &cap, (pid_t)child, job->jid, job->pid, sp);
+        }
+    }
+    for (i = 0; i < sp->n; i++)
+        closeproc(&sp->procs[i]); /* those that weren't moved */
+    free(sp->procs);
+    sp->procs = procs;
+    sp->n = n;
+    sp->cap = cap;
+    sp->gen = jl->gen;
+    sp->stale = 0;
+    sp->samples = 0;
+    qsort(sp->procs, n, sizeof(*procs), cmpproc);
+}
+
+/*
+ * addproc - Append process pid of job jid to procs, with the fds it had
+ *     in the old sampler or newly opened ones. A descendant is only
+ *     taken if it is still in process group pgid (0: don't check).
+ *     Returns 0 if it wasn't taken.
+ */
+int addproc(struct procstat_t **procs, int *n, int *cap, pid_t pid, int jid,
+            pid_t pgid, struct sampler_t *old)
+{
+    struct procstat_t *p, *prev;
+    char path[64], buf[1024];
+    unsigned long long utime, stime;
+    pid_t pgrp;
+    ssize_t got;
+
+    if (*n == *cap)
+    {
+        *cap = *cap ? 2 * *cap : 64;
+        if ((p = realloc(*procs, *cap * sizeof(**procs))) == NULL)
+            unix_error("realloc error");
+        *procs = p;
+    }
+    p = &(*procs)[*n];
+    if ((prev = findproc(old, pid)) != NULL && prev->statfd >= 0)
+    {
+        *p = *prev;
+        prev->statfd = prev->statmfd = -1; /* moved */
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+        if ((p->statfd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+            return 0;
+        snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+        p->statmfd = open(path, O_RDONLY | O_CLOEXEC);
+        p->pid = pid;
+        p->ticks = 0;
+        p->rss = 0;
+        p->fresh = 1;
+    }
+    if (pgid)
+    {
+        got = pread(p->statfd, buf, sizeof(buf) - 1, 0);
+        buf[got > 0 ? got : 0] = '\0';
+        if (p->statmfd < 0 || !parsestat(buf, &pgrp, &utime, &stime) ||
+            pgrp != pgid)
+        { /* gone, or it left the job (setsid, or a job of its own) */
+            closeproc(p);
+            return 0;
+        }
+    }
+    p->jid = jid;
+    (*n)++;
+    return 1;
+}
+
+/* findproc - Find the process pid in the sampler, NULL if it isn't */
+struct procstat_t *findproc(struct sampler_t *sp, pid_t pid)
+{
+    int lo = 0, hi = sp->n - 1, mid;
+
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        if (sp->procs[mid].pid == pid)
+            return &sp->procs[mid];
+        if (sp->procs[mid].pid < pid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+/* cmpproc - qsort order of the sampler: by PID */
+int cmpproc(const void *a, const void *b)
+{
+    pid_t x = ((const struct procstat_t *)a)->pid;
+    pid_t y = ((const struct procstat_t *)b)->pid;
+
+    return (x > y) - (x < y);
+}
+
+/* closeproc - Close the /proc fds of a sampled process */
+void closeproc(struct procstat_t *p)
+{
+    if (p->statfd >= 0)
+        close(p->statfd);
+    if (p->statmfd >= 0)
+        close(p->statmfd);
+    p->statfd = p->statmfd = -1;
+}
+
+/*
+ * takesample - Read the CPU ticks and RSS of every sampled process, and
+ *     how they changed since the previous sample, after rebuilding the
+ *     list if it is out of date. Returns the seconds since the previous
+ *     sample.
+ */
+double takesample(struct sampler_t *sp, struct joblist_t *jl)
+{
+    char buf[1024];
+    unsigned long long utime, stime;
+    struct procstat_t *p;
+    struct timespec now;
+    double dt;
+    ssize_t got;
+    pid_t pgrp;
+    long rss;
+    int i;
+
+    if (sp->gen != jl->gen || sp->stale || sp->samples >= RESCAN)
+        rebuildsampler(sp, jl);
+    sp->samples++;
+    for (i = 0; i < sp->n; i++)
+    {
+        p = &sp->procs[i];
+        if (p->statfd < 0)
+            continue;
+        got = pread(p->statfd, buf, sizeof(buf) - 1, 0);
+        buf[got > 0 ? got : 0] = '\0';
+        if (!parsestat(buf, &pgrp, &utime, &stime) ||
+            (got = pread(p->statmfd, buf, sizeof(buf) - 1, 0)) <= 0)
+        { /* it has gone */
+            closeproc(p);
+            sp->stale = 1;
+            continue;
+        }
+        buf[got] = '\0';
+        if (sscanf(buf, "%*u %ld", &rss) != 1)
+            rss = 0;
+        p->dticks = p->fresh ? 0 : utime + stime - p->ticks;
+        p->drss = p->fresh ? 0 : rss - p->rss;
+        p->ticks = utime + stime;
+        p->rss = rss;
+        p->fresh = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dt = elapsed(&sp->at, &now);
+    sp->at = now;
+    return dt;
+}
+
+/*
+ * printsample - Show the last sample, a line per job: its processes,
+ *     their CPU% over the dt seconds before it, their RSS and its change
+ */
+void printsample(struct sampler_t *sp, struct joblist_t *jl, double dt)
+{
+    static const char *states[] = {"Undefined", "Foreground", "Running",
+                                   "Stopped", "Pending"};
+    struct { int procs; unsigned long long dticks; long rss, drss; } *sum;
+    long hz = sysconf(_SC_CLK_TCK), pagekb = sysconf(_SC_PAGESIZE) / 1024;
+    struct procstat_t *p;
+    struct job_t *job;
+    int i, jid, nprocs = 0;
+
+    if ((sum = calloc(jl->maxjid + 1, sizeof(*sum))) == NULL)
+        unix_error("calloc error");
+    for (i = 0; i < sp->n; i++)
+    {
+        p = &sp->procs[i];
+        if (p->statfd < 0 || p->jid > jl->maxjid)
+            continue;
+        sum[p->jid].procs++;
+        sum[p->jid].dticks += p->dticks;
+        sum[p->jid].rss += p->rss;
+        sum[p->jid].drss += p->drss;
+        nprocs++;
+    }
+    printf("%d jobs, %d processes, over %.2fs\n", jl->count, nprocs, dt);
+    printf("%5s %7s %5s %6s %9s %9s %-10s %s\n", "JID", "PGID", "PROCS", "CPU%",
+           "RSS(KB)", "dRSS(KB)", "STATE", "COMMAND");
+    for (jid = 1; jid <= jl->maxjid; jid++)
+    {
+        if ((job = jl->byjid[jid]) == NULL)
+            continue;
+        printf("%5d %7d %5d %6.1f %9ld %+9ld %-10s %s", jid, (int)job->pid,
+               sum[jid].procs, dt > 0 ? 100.0 * sum[jid].dticks / hz / dt : 0.0,
+               sum[jid].rss * pagekb, sum[jid].drss * pagekb,
+               states[job->state <= PD ? job->state : UNDEF], job->cmdline);
+    }
+    free(sum);
+}
+
+/************************************
+ * Helper routines of job placement
+ ************************************/
+
+/*
+ * parsecpus - Parse a CPU list like 0-3,6 (as in sysfs and taskset -c)
+ *     into set. Returns 0 if it isn't one, or names no CPU.
+ */
+int parsecpus(const char *list, cpu_set_t *set)
+{
+    long lo, hi;
+    char *end;
+
+    CPU_ZERO(set);
+    for (;;)
+    {
+        if (*list < '0' || *list > '9')
+            return 0;
+        lo = hi = strtol(list, &end, 10);
+        if (*end == '-')
+        {
+            if (end[1] < '0' || end[1] > '9')
+                return 0;
+            hi = strtol(end + 1, &end, 10);
+        }
+        if (hi < lo || hi >= CPU_SETSIZE)
+            return 0;
+        for (; lo <= hi; lo++)
+            CPU_SET(lo, set);
+        if (*end != ',')
+            break;
+        list = end + 1;
+    }
+    return (*end == '\0' || *end == '\n') && CPU_COUNT(set) > 0;
+}
+
+/* readcpus - Read a CPU list from a sysfs file into set; 0 if it can't */
+int readcpus(const char *path, cpu_set_t *set)
+{
+    char buf[1024];
+    ssize_t got;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return 0;
+    got = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    buf[got > 0 ? got : 0] = '\0';
+    return parsecpus(buf, set);
+}
+
+/* printcpus - Print set as a CPU list */
+void printcpus(cpu_set_t *set)
+{
+    int lo, hi, sep = 0;
+
+    for (lo = 0; lo < CPU_SETSIZE; lo = hi + 1)
+    {
+        if (!CPU_ISSET(lo, set))
+        {
+            hi = lo;
+            continue;
+        }
+        for (hi = lo; hi + 1 < CPU_SETSIZE && CPU_ISSET(hi + 1, set); hi++)
+            ;
+        printf(hi > lo ? "%s%d-%d" : "%s%d", sep++ ? "," : "", lo, hi);
+    }
+}
+
+/*
+ * setspread - Switch spread to mode, finding its places again: each
+ *     online CPU, or the online CPUs of each NUMA node (one place for
+ *     the whole machine if there are no nodes to be found). The jobs
+ *     spread before stay where they are but no longer count. Returns 0
+ *     if the online CPUs can't be found.
+ */
+int setspread(struct spread_t *sp, int mode)
+{
+    cpu_set_t online, node;
+    char path[64];
+    int i, k, n;
+
+    free(sp->load);
+    free(sp->id);
+    free(sp->sets);
+    sp->load = sp->id = NULL;
+    sp->sets = NULL;
+    sp->nplaces = 0;
+    sp->mode = SPREAD_OFF;
+    for (k = 1; k <= jobs.maxjid; k++)
+        if (jobs.byjid[k] != NULL)
+            jobs.byjid[k]->place = -1;
+    if (mode == SPREAD_OFF)
+        return 1;
+
+    if (!readcpus("/sys/devices/system/cpu/online", &online))
+    { /* no sysfs: the first nprocs */
+        CPU_ZERO(&online);
+        n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        for (i = 0; i < n && i < CPU_SETSIZE; i++)
+            CPU_SET(i, &online);
+        if (n < 1)
+            return 0;
+    }
+    n = CPU_COUNT(&online);
+    if ((sp->load = calloc(n, sizeof(int))) == NULL ||
+        (sp->id = calloc(n, sizeof(int))) == NULL ||
+        (sp->sets = calloc(n, sizeof(cpu_set_t))) == NULL)
+        unix_error("setspread error");
+
+    if (mode == SPREAD_NODE)
+    {
+        cpu_set_t nodes;
+
+        if (readcpus("/sys/devices/system/node/online", &nodes))
+        {
+            for (k = 0; k < CPU_SETSIZE && sp->nplaces < n; k++)
+            {
+                snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", k);
+                if (!CPU_ISSET(k, &nodes) || !readcpus(path, &node))
+                    continue; /* not a node, or one with memory only */
+                CPU_AND(&sp->sets[sp->nplaces], &node, &online);
+                if (CPU_COUNT(&sp->sets[sp->nplaces]) > 0)
+                    sp->id[sp->nplaces++] = k;
+            }
+        }
+        if (sp->nplaces == 0)
+        {
+            sp->sets[0] = online;
+            sp->nplaces = 1;
+        }
+    }
+    else
+    {
+        for (k = 0; k < CPU_SETSIZE; k++)
+        {
+            if (!CPU_ISSET(k, &online))
+                continue;
+            CPU_ZERO(&sp->sets[sp->nplaces]);
+            CPU_SET(k, &sp->sets[sp->nplaces]);
+            sp->id[sp->nplaces++] = k;
+        }
+    }
+    sp->mode = mode;
+    return 1;
+}
+
+/* pickplace - The place with the fewest jobs, or -1 if spread is off */
+int pickplace(struct spread_t *sp)
+{
+    int i, best = -1;
+
+    if (sp->mode == SPREAD_OFF)
+        return -1;
+    for (i = 0; i < sp->nplaces; i++)
+        if (best < 0 || sp->load[i] < sp->load[best])
+            best = i;
+    return best;
+}
+
+/*
+ * setjobaffinity - Move every process of a job (found the way jtop
+ *     finds them: its live stages and their descendants in its process
+ *     group) onto the CPUs in set. The job no longer counts for the
+ *     place spread gave it. Returns the number of processes moved.
+ */
+int setjobaffinity(struct job_t *job, cpu_set_t *set)
+{
+    int i, moved = 0;
+
+    rebuildsampler(&sampler, &jobs);
+    for (i = 0; i < sampler.n; i++)
+        if (sampler.procs[i].jid == job->jid &&
+            sched_setaffinity(sampler.procs[i].pid, sizeof(*set), set) == 0)
+            moved++;
+    if (job->place >= 0 && job->place < spread.nplaces)
+        spread.load[job->place]--;
+    job->place = -1;
+    return moved;
+}
+
+/*****************************************
+ * Helper routines of the lifecycle trace
+ *****************************************/
+
+/* inittrace - Map the (shared, lazily backed) trace ring, off */
+void inittrace(void)
+{
+    if ((tring = mmap(NULL, sizeof(*tring), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        unix_error("mmap error");
+    tring->shell = getpid();
+    tring->t0 = tracetime();
+    tring->ns0 = monotonic_ns();
+}
+
+/* tracetime - The trace clock: the TSC on x86, else CLOCK_MONOTONIC ns */
+uint64_t tracetime(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+/* monotonic_ns - CLOCK_MONOTONIC in nanoseconds */
+uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* tracepoint - Record an event that happens now, if the trace is on */
+void tracepoint(int type, pid_t pid, int jid, int arg)
+{
+    if (tring && __atomic_load_n(&tring->on, __ATOMIC_RELAXED))
+        tracepointat(tracetime(), type, pid, jid, arg);
+}
+
+/*
+ * tracepointat - Record an event that happened at tracetime() t, if the
+ *     trace is on. Safe anywhere, even in a signal handler or a child
+ *     that shares the ring.
+ */
+void tracepointat(uint64_t t, int type, pid_t pid, int jid, int arg)
+{
+    struct trevent_t *e;
+    uint64_t n;
+
+    if (tring == NULL || !__atomic_load_n(&tring->on, __ATOMIC_RELAXED))
+        return;
+    n = __atomic_fetch_add(&tring->head, 1, __ATOMIC_RELAXED);
+    e = &tring->ev[n & (TRACECAP - 1)];
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->t = t;
+    e->pid = pid;
+    e->jid = jid;
+    e->arg = arg;
+    e->type = type;
+    __atomic_store_n(&e->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * copytrace - Copy the events in the ring that are whole into a new
+ *     array *evp, ordered by process and time, and find the length of
+ *     a tick in ns. Returns the count.
+ */
+int copytrace(struct trevent_t **evp, double *nspertick)
+{
+    struct trevent_t *ev, *e;
+    uint64_t head, n, seq, t1, ns1;
+    int count = 0;
+
+    head = __atomic_load_n(&tring->head, __ATOMIC_ACQUIRE);
+    if ((ev = malloc((head < TRACECAP ? head : TRACECAP) * sizeof(*ev) + 1)) == NULL)
+        unix_error("malloc error");
+    for (n = head > TRACECAP ? head - TRACECAP : 0; n < head; n++)
+    {
+        e = &tring->ev[n & (TRACECAP - 1)];
+        if ((seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE)) != n + 1)
+            continue;
+        ev[count] = *e;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq)
+            count++;
+    }
+    qsort(ev, count, sizeof(*ev), cmptrace);
+    *evp = ev;
+
+#if defined(__x86_64__) || defined(__i386__)
+    while ((ns1 = monotonic_ns()) - tring->ns0 < TRACECAL)
+        usleep((TRACECAL - (ns1 - tring->ns0)) / 1000 + 1);
+    t1 = tracetime();
+    *nspertick = (double)(ns1 - tring->ns0) / (t1 - tring->t0);
+#else
+    (void)t1;
+    (void)ns1;
+    *nspertick = 1;
+#endif
+    return count;
+}
+
+/* cmptrace - Order events by process, then by time */
+int cmptrace(const void *a, const void *b)
+{
+    const struct trevent_t *x = a, *y = b;
+
+    if (x->pid != y->pid)
+        return x->pid < y->pid ? -1 : 1;
+    return x->t < y->t ? -1 : x->t > y->t;
+}
+
+/*
+ * dumptrace - Write the trace to fp.
+ *
+ * As JSON, every event is an instant on the track (tid) of the process
+ * it is about, or of the shell, in microseconds since the shell
+ * started; each child that was both forked and reaped in the window
+ * also gets a slice from one to the other. The binary form is a
+ * header of the magic "TSHTRACE", the length of a tick in ns (a
+ * double), the shell's PID and the event count (two uint64_t), then the
+ * events as struct trevent_t, in the same order.
+ */
+void dumptrace(FILE *fp, int binary)
+{
+    static char *names[TR_TYPES] = {"parse", "fork", "exec", "signal received",
+                                    "signal", "continue", "stop", "reap",
+                                    "fg done"};
+    struct trevent_t *ev, *fork = NULL;
+    double nspertick, us;
+    uint64_t hdr[2];
+    int n, i, sep = 0;
+
+    n = copytrace(&ev, &nspertick);
+    if (binary)
+    {
+        hdr[0] = tring->shell;
+        hdr[1] = n;
+        fwrite("TSHTRACE", 1, 8, fp);
+        fwrite(&nspertick, sizeof(nspertick), 1, fp);
+        fwrite(hdr, sizeof(hdr), 1, fp);
+        fwrite(ev, sizeof(*ev), n, fp);
+        free(ev);
+        return;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (i = 0; i < n; i++)
+    {
+        us = (double)(int64_t)(ev[i].t - tring->t0) * nspertick / 1e3;
+        if (i == 0 || ev[i].pid != ev[i - 1].pid)
+            fork = NULL;
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                    "\"pid\":%d,\"tid\":%d,\"args\":{\"jid\":%d,\"arg\":%d}}",
+                sep++ ? ",\n" : "", ev[i].type < TR_TYPES ? names[ev[i].type] : "?",
+                us, (int)tring->shell, ev[i].pid ? (int)ev[i].pid : (int)tring->shell,
+                ev[i].jid, ev[i].arg);
+        if (ev[i].pid == 0)
+            continue;
+        if (ev[i].type == TR_FORK)
+            fork = &ev[i];
+        else if (ev[i].type == TR_REAP && fork)
+        {
+            fprintf(fp, ",\n{\"name\":\"process %d\",\"ph\":\"X\",\"ts\":%.3f,"
+                        "\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"jid\":%d,"
+                        "\"status\":%d}}",
+                    (int)ev[i].pid,
+                    (double)(int64_t)(fork->t - tring->t0) * nspertick / 1e3,
+                    (double)(int64_t)(ev[i].t - fork->t) * nspertick / 1e3,
+                    (int)tring->shell, (int)ev[i].pid, ev[i].jid, ev[i].arg);
+            fork = NULL;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    free(ev);
+}
+
+/*************************************************
+ * Helper routines that manage the command hash
+ ************************************************/
+
+/* initcmds - (Re)initialize the command hash for a new $PATH */
+void initcmds(struct cmdcache_t *cc, const char *path)
+{
+    char *dir;
+    int i;
+
+    clearcmds(cc);
+    free(cc->path);
+    free(cc->dirs);
+    free(cc->mtime);
+    if (cc->tab == NULL)
+    {
+        cc->cap = HASHCAP;
+        if ((cc->tab = calloc(cc->cap, sizeof(struct cmdhash_t))) == NULL)
+            unix_error("initcmds error");
+    }
+
+    if ((cc->path = strdup(path ? path : "")) == NULL)
+        unix_error("initcmds error");
+    cc->ndirs = 1;
+    for (i = 0; cc->path[i]; i++)
+        if (cc->path[i] == ':')
+            cc->ndirs++;
+    if ((cc->dirs = malloc(cc->ndirs * sizeof(char *))) == NULL ||
+        (cc->mtime = calloc(cc->ndirs, sizeof(struct timespec))) == NULL)
+        unix_error("initcmds error");
+    for (i = 0, dir = cc->path; i < cc->ndirs; i++)
+    {
+        cc->dirs[i] = dir;
+        if ((dir = strchr(dir, ':')) != NULL)
+            *dir++ = '\0';
+        if (!*cc->dirs[i])
+            cc->dirs[i] = "."; /* an empty entry means the cwd */
+    }
+    cc->checked = 0;
+    checkcmddirs(cc);
+}
+
+/* clearcmds - Forget all remembered commands */
+void clearcmds(struct cmdcache_t *cc)
+{
+    int i;
+
+    for (i = 0; i < cc->cap && cc->count; i++)
+    {
+        if (cc->tab[i].name)
+        {
+            free(cc->tab[i].name);
+            free(cc->tab[i].path);
+            cc->tab[i].name = NULL;
+            cc->count--;
+        }
+    }
+}
+
+/*
+ * checkcmddirs - Compare the mtime of every $PATH directory with the one
+ *     seen last time (at most once a second), and forget all commands if
+ *     any of them changed. Returns 1 if the hash was flushed.
+ */
+int checkcmddirs(struct cmdcache_t *cc)
+{
+    struct timespec now;
+    struct stat st;
+    int i, changed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (cc->checked && now.tv_sec == cc->checked)
+        return 0;
+    cc->checked = now.tv_sec;
+
+    for (i = 0; i < cc->ndirs; i++)
+    {
+        if (stat(cc->dirs[i], &st) < 0)
+            memset(&st.st_mtim, 0, sizeof(st.st_mtim));
+        if (st.st_mtim.tv_sec != cc->mtime[i].tv_sec ||
+            st.st_mtim.tv_nsec != cc->mtime[i].tv_nsec)
+        {
+            cc->mtime[i] = st.st_mtim;
+            changed = 1;
+        }
+    }
+    if (changed)
+        clearcmds(cc);
+    return changed;
+}
+
+/* cmdslot - Slot of name in the command hash, or the empty slot where
+ *     it would go */
+int cmdslot(struct cmdcache_t *cc, const char *name)
+{
+    unsigned h = 2166136261u; /* FNV-1a */
+    const char *p;
+    int i;
+
+    for (p = name; *p; p++)
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    for (i = h & (cc->cap - 1); cc->tab[i].name; i = (i + 1) & (cc->cap - 1))
+        if (!strcmp(cc->tab[i].name, name))
+            break;
+    return i;
+}
+
+/*
+ * findcmd - Return the file to execute for command name: name itself if
+ *     it contains a '/', else its location on $PATH (remembered in the
+ *     command hash), or NULL if there is no such command.
+ */
+char *findcmd(struct cmdcache_t *cc, const char *name)
+{
+    char buf[PATH_MAX];
+    struct cmdhash_t *e, *old;
+    struct stat st;
+    int i, n, oldcap;
+
+    if (strchr(name, '/'))
+        return (char *)name;
+
+    checkcmddirs(cc);
+    e = &cc->tab[cmdslot(cc, name)];
+    if (e->name)
+    {
+        if (stat(cc->dirs[e->dir], &st) == 0 &&
+            st.st_mtim.tv_sec == cc->mtime[e->dir].tv_sec &&
+            st.st_mtim.tv_nsec == cc->mtime[e->dir].tv_nsec)
+        {
+            e->hits++;
+            return e->path;
+        }
+        cc->checked = 0; /* its directory changed: recheck them all */
+        checkcmddirs(cc);
+    }
+
+    for (i = 0; i < cc->ndirs; i++)
+    {
+        n = snprintf(buf, sizeof(buf), "%s/%s", cc->dirs[i], name);
+        if (n < 0 || n >= (int)sizeof(buf))
+            continue; /* cut short it would name another file, if any */
+        if (stat(buf, &st) == 0 && S_ISREG(st.st_mode) && (st.st_mode & 0111))
+            break;
+    }
+    if (i == cc->ndirs)
+        return NULL;
+
+    if (2 * (cc->count + 1) > cc->cap)
+    { /* keep the table at most half full */
+        old = cc->tab;
+        oldcap = cc->cap;
+        if ((cc->tab = calloc(2 * oldcap, sizeof(struct cmdhash_t))) == NULL)
+            unix_error("findcmd error");
+        cc->cap *= 2;
+        for (e = old; e < old + oldcap; e++)
+            if (e->name)
+                cc->tab[cmdslot(cc, e->name)] = *e;
+        free(old);
+    }
+    e = &cc->tab[cmdslot(cc, name)];
+    if ((e->name = strdup(name)) == NULL || (e->path = strdup(buf)) == NULL)
+        unix_error("findcmd error");
+    e->dir = i;
+    e->hits = 1;
+    cc->count++;
+    return e->path;
+}
+
+/* listcmds - Print the command hash */
+void listcmds(struct cmdcache_t *cc)
+{
+    int i;
+
+    if (!cc->count)
+    {
+        printf("hash: hash table empty\n");
+        return;
+    }
+    printf("hits\tcommand\n");
+    for (i = 0; i < cc->cap; i++)
+        if (cc->tab[i].name)
+            printf("%4d\t%s\n", cc->tab[i].hits, cc->tab[i].path);
+}
+/*********************************
+ * end command hash helper routines
+ *********************************/
+
+/*************************************************
+ * Helper routines that manage the environment
+ ************************************************/
+
+/* initenv - Fill the environment hash with the NAME=value entries of envp */
+void initenv(struct envtab_t *et, char **envp)
+{
+    char *eq;
+
+    et->cap = ENVCAP;
+    if ((et->tab = calloc(et->cap, sizeof(struct envvar_t))) == NULL)
+        unix_error("initenv error");
+    for (; *envp; envp++)
+        if ((eq = strchr(*envp, '=')) != NULL && eq != *envp)
+            setenvvar(et, *envp, eq - *envp, eq + 1);
+    buildenv(et);
+}
+
+/* envslot - Slot of the variable named by the namelen bytes at name,
+ *     or the empty slot where it would go */
+int envslot(struct envtab_t *et, const char *name, size_t namelen)
+{
+    unsigned h = 2166136261u; /* FNV-1a */
+    struct envvar_t *v;
+    size_t k;
+    int i;
+
+    for (k = 0; k < namelen; k++)
+        h = (h ^ (unsigned char)name[k]) * 16777619u;
+    for (i = h & (et->cap - 1); (v = &et->tab[i])->entry; i = (i + 1) & (et->cap - 1))
+        if (v->namelen == namelen && !memcmp(v->entry, name, namelen))
+            break;
+    return i;
+}
+
+/* getenvvar - Value of variable name, or NULL if it isn't set */
+char *getenvvar(struct envtab_t *et, const char *name)
+{
+    size_t namelen = strlen(name);
+    struct envvar_t *v = &et->tab[envslot(et, name, namelen)];
+
+    return v->entry ? v->entry + namelen + 1 : NULL;
+}
+
+/*
+ * setenvvar - Set the variable named by the namelen bytes at name to
+ *     value, in envp too. Setting the value it already has changes
+ *     nothing.
+ */
+void setenvvar(struct envtab_t *et, const char *name, size_t namelen,
+               const char *value)
+{
+    struct envvar_t *v, *old;
+    size_t vlen = strlen(value);
+    char *entry;
+    int oldcap;
+
+    v = &et->tab[envslot(et, name, namelen)];
+    if (v->entry && !strcmp(v->entry + namelen + 1, value))
+        return;
+    if ((entry = poolalloc(&strpool, namelen + vlen + 2)) == NULL)
+        unix_error("setenvvar error");
+    memcpy(entry, name, namelen);
+    entry[namelen] = '=';
+    memcpy(entry + namelen + 1, value, vlen + 1);
+
+    if (v->entry)
+    { /* nothing may see the old entry once it is back in the pool */
+        et->envp[v->envidx] = entry;
+        poolfree(&strpool, v->entry);
+        v->entry = entry;
+        return;
+    }
+    if (et->count + 2 > et->envcap)
+    { /* environ is moved with envp, as libc would move it */
+        et->envcap = 2 * (et->count + 2);
+        if ((et->envp = realloc(et->envp, et->envcap * sizeof(char *))) == NULL)
+            unix_error("setenvvar error");
+        environ = et->envp;
+    }
+    if (2 * (et->count + 1) > et->cap)
+    { /* keep the table at most half full */
+        old = et->tab;
+        oldcap = et->cap;
+        if ((et->tab = calloc(2 * oldcap, sizeof(struct envvar_t))) == NULL)
+            unix_error("setenvvar error");
+        et->cap *= 2;
+        for (v = old; v < old + oldcap; v++)
+            if (v->entry)
+                et->tab[envslot(et, v->entry, v->namelen)] = *v;
+        free(old);
+        v = &et->tab[envslot(et, name, namelen)];
+    }
+    v->entry = entry;
+    v->namelen = namelen;
+    v->envidx = et->count;
+    et->envp[et->count++] = entry;
+    et->envp[et->count] = NULL;
+}
+
+/*
+ * buildenv - Return the environment as a NULL terminated envp array.
+ *     setenvvar keeps it current; this only makes an empty one, and
+ *     points libc's environ at it, for anything that calls getenv.
+ */
+char **buildenv(struct envtab_t *et)
+{
+    if (et->envp == NULL)
+    {
+        et->envcap = 1;
+        if ((et->envp = calloc(et->envcap, sizeof(char *))) == NULL)
+            unix_error("buildenv error");
+    }
+    environ = et->envp;
+    return et->envp;
+}
+/*************************************************
+ * end environment helper routines
+ ************************************************/
+
+/***********************
+ * Other helper routines
+ ***********************/
+
+/* arenaalloc - Get size bytes from the arena, in a new block if the
+ *     current one is full */
+void *arenaalloc(struct arena_t *a, size_t size)
+{
+    char *block;
+    size_t cap;
+
+    size = (size + ARENAALIGN - 1) & ~(size_t)(ARENAALIGN - 1);
+    if (a->block == NULL || a->used + size > a->cap)
+    {
+        cap = a->cap ? 2 * a->cap : ARENAMIN;
+        while (cap < ARENAALIGN + size)
+            cap *= 2;
+        if ((block = malloc(cap)) == NULL)
+            unix_error("arenaalloc error");
+        memcpy(block, &a->block, sizeof(char *)); /* link the old block */
+        a->block = block;
+        a->used = ARENAALIGN;
+        a->cap = cap;
+    }
+    a->used += size;
+    a->total += size;
+    return a->block + a->used - size;
+}
+
+/* arenareset - Release everything allocated from the arena. If that took
+ *     more than one block, they are replaced by one that holds it all. */
+void arenareset(struct arena_t *a)
+{
+    char *prev;
+    size_t cap;
+
+    if (a->block == NULL)
+        return;
+    memcpy(&prev, a->block, sizeof(char *));
+    if (prev)
+    {
+        cap = a->cap;
+        while (cap < ARENAALIGN + a->total)
+            cap *= 2;
+        while (a->block)
+        {
+            memcpy(&prev, a->block, sizeof(char *));
+            free(a->block);
+            a->block = prev;
+        }
+        if ((a->block = malloc(cap)) == NULL)
+            unix_error("arenareset error");
+        memcpy(a->block, &prev, sizeof(char *)); /* prev is NULL now */
+        a->cap = cap;
+    }
+    a->used = ARENAALIGN;
+    a->total = 0;
+}
+
+/*
+ * fastname - If cmd is one of the commands run inside the shell (echo,
+ *     printf, true, false, test, [ and pwd), bare or as /bin/cmd or
+ *     /usr/bin/cmd, return its bare name, else NULL. With -E there are
+ *     none.
+ */
+char *fastname(char *cmd)
+{
+    static char *fast[] = {"echo", "printf", "true", "false", "test", "[",
+                           "pwd", NULL};
+    int i;
+
+    if (use_external)
+        return NULL;
+    if (!strncmp(cmd, "/bin/", 5))
+        cmd += 5;
+    else if (!strncmp(cmd, "/usr/bin/", 9))
+        cmd += 9;
+    for (i = 0; fast[i]; i++)
+        if (!strcmp(cmd, fast[i]))
+            return cmd;
+    return NULL;
+}
+
+/* cmderror - Print a builtin's error message on stderr, after what it
+ *     has already written to stdout */
+void cmderror(const char *fmt, ...)
+{
+    va_list ap;
+
+    fflush(stdout);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+/*
+ * printesc - Print the backslash escape at s (just past the '\') the way
+ *     printf does in its format, or in %b (octal0: \0NNN is octal too),
+ *     or echo -e (echo: as %b, but \" and a bad \x are left alone).
+ *     Returns the number of bytes of s used, or -1 if nothing more is to
+ *     be printed (\c, or a bad \x in printf).
+ */
+int printesc(const char *s, int octal0, int echo)
+{
+    const char *p = s;
+    int c = 0, k;
+
+    if (*p == 'x')
+    {
+        for (k = 0, p++; k < 2 && isxdigit((unsigned char)*p); k++, p++)
+            c = c * 16 + (isdigit((unsigned char)*p) ? *p - '0'
+                                                     : tolower((unsigned char)*p) - 'a' + 10);
+        if (k == 0 && !echo)
+        {
+            cmderror("printf: missing hexadecimal number in escape\n");
+            return -1;
+        }
+        if (k == 0)
+        {
+            printf("\\x");
+            return 1;
+        }
+        putchar(c);
+        return p - s;
+    }
+    if (*p >= '0' && *p <= '7')
+    {
+        if (octal0 && *p == '0')
+            p++;
+        for (k = 0; k < 3 && *p >= '0' && *p <= '7'; k++, p++)
+            c = c * 8 + (*p - '0');
+        putchar(c);
+        return p - s;
+    }
+    switch (*p)
+    {
+    case 'a': c = '\a'; break;
+    case 'b': c = '\b'; break;
+    case 'e': c = '\033'; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'v': c = '\v'; break;
+    case '\\': c = '\\'; break;
+    case 'c':
+        return -1;
+    case '"':
+        if (!echo)
+        {
+            c = '"';
+            break;
+        }
+        /* fall through */
+    default:
+        putchar('\\');
+        if (*p == '\0')
+            return 0;
+        c = *p;
+    }
+    putchar(c);
+    return 1;
+}
+
+/*
+ * printformat - Print fmt once for printf, taking the values of its
+ *     conversions from args (0 or "" once they run out). Returns the
+ *     number of args used; sets *stop if printf must print no more.
+ */
+int printformat(const char *fmt, char **args, int *stop)
+{
+    char spec[64], *sp, conv;
+    const char *f, *arg;
+    int used = 0, n;
+
+    for (f = fmt; *f; f++)
+    {
+        if (*f == '\\')
+        {
+            if ((n = printesc(f + 1, 0, 0)) < 0)
+            {
+                *stop = 1;
+                return used;
+            }
+            f += n;
+            continue;
+        }
+        if (*f != '%')
+        {
+            putchar(*f);
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            putchar('%');
+            f++;
+            continue;
+        }
+
+        /* %[flags][width][.precision][size]conversion, rebuilt for printf
+         * with the size we pass */
+        sp = spec;
+        *sp++ = '%';
+        for (f++; *f && strchr("-+ #0'", *f); f++)
+            if (sp < spec + 8)
+                *sp++ = *f;
+        if (*f == '*')
+        {
+            sp += sprintf(sp, "%d", (int)intarg(args[used] ? args[used++] : NULL));
+            f++;
+        }
+        for (; isdigit((unsigned char)*f); f++)
+            if (sp < spec + 28)
+                *sp++ = *f;
+        if (*f == '.')
+        {
+            *sp++ = *f++;
+            if (*f == '*')
+            {
+                sp += sprintf(sp, "%d", (int)intarg(args[used] ? args[used++] : NULL));
+                f++;
+            }
+            for (; isdigit((unsigned char)*f); f++)
+                if (sp < spec + 52)
+                    *sp++ = *f;
+        }
+        while (*f && strchr("hlLjzt", *f))
+            f++;
+        conv = *f;
+        arg = args[used] ? args[used++] : NULL;
+        switch (conv)
+        {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            sp[0] = 'j';
+            sp[1] = conv;
+            sp[2] = '\0';
+            printf(spec, intarg(arg));
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A':
+            sp[0] = 'L';
+            sp[1] = conv;
+            sp[2] = '\0';
+            printf(spec, floatarg(arg));
+            break;
+        case 'c':
+        case 's':
+            sp[0] = conv;
+            sp[1] = '\0';
+            if (conv == 'c')
+                printf(spec, arg ? *arg : '\0');
+            else
+                printf(spec, arg ? arg : "");
+            break;
+        case 'q': /* quoted for the shell, if it has to be */
+            if (arg == NULL)
+                arg = "";
+            if (*arg && strspn(arg, "abcdefghijklmnopqrstuvwxyz"
+                                    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                    "0123456789_./,:+@%=-") == strlen(arg))
+            {
+                fputs(arg, stdout);
+                break;
+            }
+            putchar('\'');
+            for (; *arg; arg++)
+            {
+                if (*arg == '\'')
+                    printf("'\\''");
+                else
+                    putchar(*arg);
+            }
+            putchar('\'');
+            break;
+        case 'b':
+            for (; arg && *arg; arg++)
+            {
+                if (*arg != '\\' || !arg[1])
+                    putchar(*arg);
+                else if ((n = printesc(arg + 1, 1, 0)) < 0)
+                {
+                    *stop = 1;
+                    return used;
+                }
+                else
+                    arg += n;
+            }
+            break;
+        default:
+            if (conv)
+                cmderror("printf: %%%c: invalid conversion specification\n", conv);
+            else
+                cmderror("printf: %%: invalid conversion specification\n");
+            *stop = 1;
+            return used;
+        }
+    }
+    return used;
+}
+
+/* intarg - Value of a numeric printf argument ('c is the code of c),
+ *     0 if it is missing; complains if it isn't a number */
+intmax_t intarg(const char *arg)
+{
+    intmax_t v;
+    char *end;
+
+    if (arg == NULL)
+        return 0;
+    if (*arg == '\'' || *arg == '"')
+        return (unsigned char)arg[1];
+    errno = 0;
+    v = strtoimax(arg, &end, 0);
+    if (errno == ERANGE && *arg != '-')
+    { /* a big unsigned value, for %u, %o and %x */
+        errno = 0;
+        v = (intmax_t)strtoumax(arg, &end, 0);
+    }
+    if (end == arg)
+        cmderror("printf: '%s': expected a numeric value\n", arg);
+    else if (*end)
+        cmderror("printf: '%s': value not completely converted\n", arg);
+    else if (errno == ERANGE)
+        cmderror("printf: '%s': %s\n", arg, strerror(ERANGE));
+    return v;
+}
+
+/* floatarg - Value of a floating point printf argument, as intarg */
+long double floatarg(const char *arg)
+{
+    long double v;
+    char *end;
+
+    if (arg == NULL)
+        return 0;
+    if (*arg == '\'' || *arg == '"')
+        return (unsigned char)arg[1];
+    errno = 0;
+    v = strtold(arg, &end);
+    if (end == arg)
+        cmderror("printf: '%s': expected a numeric value\n", arg);
+    else if (*end)
+        cmderror("printf: '%s': value not completely converted\n", arg);
+    else if (errno == ERANGE)
+        cmderror("printf: '%s': %s\n", arg, strerror(ERANGE));
+    return v;
+}
+
+/*
+ * testargs - Evaluate a test expression of 1 to 3 arguments by the
+ *     POSIX rules for that many. Returns 1 true, 0 false, -1 error (as
+ *     do the other test helpers).
+ */
+int testargs(char **argv, int n)
+{
+    int pos = 0, r;
+
+    if (n == 1)
+        return *argv[0] != '\0';
+    if (n == 2)
+    {
+        if (!strcmp(argv[0], "!"))
+            return *argv[1] == '\0';
+        if (isunaryop(argv[0]))
+            return testunary(argv[0], argv[1]);
+        if (argv[0][0] == '-' && argv[0][1] && !argv[0][2])
+            cmderror("test: '%s': unary operator expected\n", argv[0]);
+        else
+            cmderror("test: missing argument after '%s'\n", argv[1]);
+        return -1;
+    }
+    if (isbinaryop(argv[1]))
+        return testbinary(argv[0], argv[1], argv[2]);
+    if (!strcmp(argv[0], "!"))
+    {
+        r = testargs(argv + 1, 2);
+        return r < 0 ? r : !r;
+    }
+    if (!strcmp(argv[0], "(") && !strcmp(argv[2], ")"))
+        return *argv[1] != '\0';
+    if (!strcmp(argv[1], "-a") || !strcmp(argv[1], "-o"))
+        return testexpr(argv, &pos, n);
+    cmderror("test: '%s': binary operator expected\n", argv[1]);
+    return -1;
+}
+
+/* testexpr - Evaluate test's expr: and-expr [-o and-expr]... from
+ *     argv[*pos], leaving *pos after it */
+int testexpr(char **argv, int *pos, int n)
+{
+    int r, r2;
+
+    if ((r = testand(argv, pos, n)) < 0)
+        return r;
+    while (*pos < n && !strcmp(argv[*pos], "-o"))
+    {
+        (*pos)++;
+        if ((r2 = testand(argv, pos, n)) < 0)
+            return r2;
+        r = r || r2;
+    }
+    return r;
+}
+
+/* testand - Evaluate test's and-expr: term [-a term]... */
+int testand(char **argv, int *pos, int n)
+{
+    int r, r2;
+
+    if ((r = testterm(argv, pos, n)) < 0)
+        return r;
+    while (*pos < n && !strcmp(argv[*pos], "-a"))
+    {
+        (*pos)++;
+        if ((r2 = testterm(argv, pos, n)) < 0)
+            return r2;
+        r = r && r2;
+    }
+    return r;
+}
+
+/* testterm - Evaluate test's term: ! term, ( expr ), a binary or unary
+ *     test, or a string (true if not empty) */
+int testterm(char **argv, int *pos, int n)
+{
+    int r;
+
+    if (*pos >= n)
+    {
+        cmderror("test: missing argument after '%s'\n", argv[n - 1]);
+        return -1;
+    }
+    if (!strcmp(argv[*pos], "!"))
+    {
+        (*pos)++;
+        r = testterm(argv, pos, n);
+        return r < 0 ? r : !r;
+    }
+    if (!strcmp(argv[*pos], "("))
+    {
+        (*pos)++;
+        if ((r = testexpr(argv, pos, n)) < 0)
+            return r;
+        if (*pos >= n || strcmp(argv[*pos], ")"))
+        {
+            cmderror("test: ')' expected\n");
+            return -1;
+        }
+        (*pos)++;
+        return r;
+    }
+    if (n - *pos >= 3 && isbinaryop(argv[*pos + 1]))
+    {
+        r = testbinary(argv[*pos], argv[*pos + 1], argv[*pos + 2]);
+        *pos += 3;
+        return r;
+    }
+    if (isunaryop(argv[*pos]))
+    {
+        if (n - *pos < 2)
+        {
+            cmderror("test: missing argument after '%s'\n", argv[*pos]);
+            return -1;
+        }
+        r = testunary(argv[*pos], argv[*pos + 1]);
+        *pos += 2;
+        return r;
+    }
+    return *argv[(*pos)++] != '\0';
+}
+
+/* isunaryop - Is op one of test's unary operators? */
+int isunaryop(const char *op)
+{
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefgGhkLnNOprsStuwxz", op[1]);
+}
+
+/* isbinaryop - Is op one of test's binary operators? */
+int isbinaryop(const char *op)
+{
+    static char *ops[] = {"=", "==", "!=", "-eq", "-ne", "-lt", "-le",
+                          "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+    int i;
+
+    for (i = 0; ops[i]; i++)
+        if (!strcmp(op, ops[i]))
+            return 1;
+    return 0;
+}
+
+/* testunary - Apply test's unary operator op to arg */
+int testunary(const char *op, const char *arg)
+{
+    struct stat st;
+    long long fd;
+
+    switch (op[1])
+    {
+    case 'z':
+        return *arg == '\0';
+    case 'n':
+        return *arg != '\0';
+    case 't':
+        return testint(arg, &fd) ? isatty(fd) : -1;
+    case 'h':
+    case 'L':
+        return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 'r':
+        return eaccess(arg, R_OK) == 0;
+    case 'w':
+        return eaccess(arg, W_OK) == 0;
+    case 'x':
+        return eaccess(arg, X_OK) == 0;
+    }
+    if (stat(arg, &st) < 0)
+        return 0;
+    switch (op[1])
+    {
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'f': return S_ISREG(st.st_mode);
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    case 'O': return st.st_uid == geteuid();
+    case 'G': return st.st_gid == getegid();
+    case 'N':
+        return st.st_mtim.tv_sec > st.st_atim.tv_sec ||
+               (st.st_mtim.tv_sec == st.st_atim.tv_sec &&
+                st.st_mtim.tv_nsec > st.st_atim.tv_nsec);
+    default: /* -e */
+        return 1;
+    }
+}
+
+/* testbinary - Apply test's binary operator op to l and r */
+int testbinary(const char *l, const char *op, const char *r)
+{
+    struct stat sl, sr;
+    long long a, b;
+    int okl, okr, cmp;
+
+    if (!strcmp(op, "=") || !strcmp(op, "=="))
+        return !strcmp(l, r);
+    if (!strcmp(op, "!="))
+        return strcmp(l, r) != 0;
+    if (!strcmp(op, "-nt") || !strcmp(op, "-ot") || !strcmp(op, "-ef"))
+    {
+        okl = stat(l, &sl) == 0;
+        okr = stat(r, &sr) == 0;
+        if (op[1] == 'e')
+            return okl && okr && sl.st_dev == sr.st_dev && sl.st_ino == sr.st_ino;
+        if (!okl || !okr)
+            return op[1] == 'n' ? okl : okr;
+        cmp = sl.st_mtim.tv_sec != sr.st_mtim.tv_sec
+                  ? (sl.st_mtim.tv_sec > sr.st_mtim.tv_sec ? 1 : -1)
+                  : (sl.st_mtim.tv_nsec > sr.st_mtim.tv_nsec) - (sl.st_mtim.tv_nsec < sr.st_mtim.tv_nsec);
+        return op[1] == 'n' ? cmp > 0 : cmp < 0;
+    }
+    if (!testint(l, &a) || !testint(r, &b))
+        return -1;
+    if (!strcmp(op, "-eq"))
+        return a == b;
+    if (!strcmp(op, "-ne"))
+        return a != b;
+    if (!strcmp(op, "-lt"))
+        return a < b;
+    if (!strcmp(op, "-le"))
+        return a <= b;
+    if (!strcmp(op, "-gt"))
+        return a > b;
+    return a >= b; /* -ge */
+}
+
+/* testint - Parse an integer operand of test (blanks around it are
+ *     allowed); 0 and a complaint if it isn't one */
+int testint(const char *arg, long long *val)
+{
+    char *end;
+    int digits;
+
+    errno = 0;
+    *val = strtoll(arg, &end, 10);
+    digits = end > arg && isdigit((unsigned char)end[-1]);
+    while (isspace((unsigned char)*end))
+        end++;
+    if (!digits || *end || errno == ERANGE)
+    {
+        cmderror("test: invalid integer '%s'\n", arg);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * catbuiltin - True if cat argv can run inside the shell: it names at
+ *     least one file and has no options (so it never reads the shell's
+ *     stdin). Anything else runs the external cat.
+ */
+int catbuiltin(char **argv)
+{
+    int i;
+
+    for (i = 1; argv[i]; i++)
+        if (argv[i][0] == '-')
+            return 0;
+    return i > 1;
+}
+
+/*
+ * copyfd - Copy file in to out until end of file, in the kernel where it
+ *     can: splice into a pipe, copy_file_range into a file, sendfile into
+ *     anything else, and read/write only if all of those are refused.
+ *     Returns 0, or -1 with errno set.
+ */
+int copyfd(int in, int out)
+{
+    static char buf[COPYBUF];
+    struct stat st;
+    ssize_t n;
+    int how, copied = 0; /* how: 0 splice, 1 copy_file_range, 2 sendfile */
+
+    if (fstat(out, &st) < 0)
+        return -1;
+    how = S_ISFIFO(st.st_mode) ? 0 : S_ISREG(st.st_mode) ? 1 : 2;
+    while (1)
+    {
+        if (how == 0)
+            n = splice(in, NULL, out, NULL, COPYCHUNK, SPLICE_F_MOVE);
+        else if (how == 1)
+            n = copy_file_range(in, NULL, out, NULL, COPYCHUNK, 0);
+        else if (how == 2)
+            n = sendfile(out, in, NULL, COPYCHUNK);
+        else if ((n = read(in, buf, sizeof(buf))) > 0 && writeall(out, buf, n) < 0)
+            return -1;
+
+        if (n == 0)
+            return 0;
+        if (n > 0)
+            copied = 1;
+        else if (errno == EINTR)
+            continue;
+        else if (!copied && how < 3 &&
+                 (errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+                  errno == EOPNOTSUPP || errno == EBADF))
+            how = (how == 0) ? 2 : how + 1; /* not for these files */
+        else
+            return -1;
+    }
+}
+
+/* writeall - Write all len bytes of buf to fd; 0, or -1 on error */
+int writeall(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0)
+    {
+        if ((n = write(fd, buf, len)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * openreader - Read the shell's input from fd. A regular file is mapped
+ *     (and fd left at its end, so children don't read the script);
+ *     anything else gets a read buffer.
+ */
+void openreader(struct reader_t *r, int fd)
+{
+    struct stat st;
+    void *map;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    if (fstat(fd, &st) < 0)
+        st.st_mode = 0;
+    r->dev = st.st_dev;
+    r->ino = st.st_ino;
+    if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED)
+    {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        r->buf = map;
+        r->len = st.st_size;
+        r->fd = -1;
+        if (fd == STDIN_FILENO)
+            lseek(fd, 0, SEEK_END);
+        else
+            close(fd);
+        return;
+    }
+    r->cap = READBLOCK;
+    if ((r->buf = malloc(r->cap)) == NULL)
+        unix_error("malloc error");
+}
+
+/*
+ * closereader - Free what openreader() allocated or mapped for r. The fd
+ *     of input that was read, not mapped, is left to the caller.
+ */
+void closereader(struct reader_t *r)
+{
+    if (r->cap)
+        free(r->buf);
+    else if (r->buf)
+        munmap(r->buf, r->len);
+    free(r->line);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+/* stringreader - Read the shell's input from str (for -c) */
+void stringreader(struct reader_t *r, char *str)
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    r->buf = str;
+    r->len = strlen(str);
+}
+
+/*
+ * nextline - Return the next line of input, or NULL at the end. A last
+ *     line without a newline gets one. Before waiting for input that
+ *     hasn't come yet, stdout is flushed; the event loop runs while we
+ *     wait.
+ */
+char *nextline(struct reader_t *r)
+{
+    char *nl;
+    size_t n;
+    ssize_t got;
+
+    while ((nl = memchr(r->buf + r->pos, '\n', r->len - r->pos)) == NULL &&
+           r->fd >= 0)
+    {
+        if (r->pos > 0)
+        { /* keep the partial line at the start of the buffer */
+            memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+            r->len -= r->pos;
+            r->pos = 0;
+        }
+        if (r->len == r->cap && (r->buf = realloc(r->buf, r->cap *= 2)) == NULL)
+            unix_error("realloc error");
+        fflush(stdout);
+        while (!runevents(&loop, 1))
+            fflush(stdout); /* news about the jobs while we wait */
+        if ((got = read(r->fd, r->buf + r->len, r->cap - r->len)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            unix_error("read error");
+        }
+        if (got == 0)
+            r->fd = -1; /* end of input */
+        r->len += got;
+    }
+    if (r->pos == r->len)
+        return NULL;
+
+    n = (nl ? nl + 1 : r->buf + r->len) - (r->buf + r->pos);
+    if (n + 2 > r->linecap)
+    {
+        r->linecap = n + 2 > MAXLINE ? 2 * n : MAXLINE;
+        if ((r->line = realloc(r->line, r->linecap)) == NULL)
+            unix_error("realloc error");
+    }
+    memcpy(r->line, r->buf + r->pos, n);
+    r->pos += n;
+    if (!nl)
+        r->line[n++] = '\n';
+    r->line[n] = '\0';
+    return r->line;
+}
+
+/*
+ * usage - print a help message
+ */
+void usage(void)
+{
+    printf("Usage: shell [-hvpszEo] [-c command | script]\n");
+    printf("   -h   print this message\n");
+    printf("   -v   print additional diagnostic information\n");
+    printf("   -p   do not emit a command prompt\n");
+    printf("   -s   launch jobs with posix_spawn instead of fork\n");
+    printf("   -z   launch jobs through a zygote forked at startup\n");
+    printf("   -E   run echo, printf, true, false, test, [ and pwd as programs\n");
+    printf("   -o   capture the output of background jobs (see jobs -o)\n");
+    printf("   -c   run the commands in the string, then exit\n");
+    exit(1);
+}
+
+/*
+ * unix_error - unix-style error routine
+ */
+void unix_error(char *msg)
+{
+    fprintf(stdout, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * app_error - application-style error routine
+ */
+void app_error(char *msg)
+{
+    fprintf(stdout, "%s\n", msg);
+    exit(1);
+}
+
+/*
+ * sigquit_handler - The driver program can gracefully terminate the
+ *    child shell by sending it a SIGQUIT signal.
+ */
+void sigquit_handler(int sig)
+{
+    printf("Terminating after receipt of SIGQUIT signal\n");
+    exit(1);
+}
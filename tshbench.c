@@ -0,0 +1,2029 @@
+/*
+ * tshbench - Benchmark driver for the tiny shell
+ *
+ * usage: tshbench [-h] [-s <shell>] [-a <arg>] [-c <cmd>] [-n <count>]
+ *                 [-j <jobs>] <mode>
+ *
+ * Runs the shell as a child with its stdin and stdout connected to
+ * pipes, feeds it command lines and times how long it takes for the
+ * prompt to come back. With -j, the latency mode first fills the job
+ * list with <jobs> sleeping background jobs, to show how the size of
+ * the shell affects launching.
+ *
+ * Modes:
+ *     latency   Run <count> /bin/true commands (or <cmd>) in the
+ *               foreground and report the p50/p99 turnaround of eval().
+ *               tsh runs true and /bin/true itself unless it has -E
+ *               (-a -E), so without it this times the builtin.
+ *     reap      Launch <count> background myspin jobs, kill them all at
+ *               the same moment and check that every one of them is
+ *               reaped, reported and removed from the job list.
+ *     jobs      Fill the job list with <count> background jobs and time
+ *               the bg and kill builtins on random JIDs, which measures
+ *               the job list lookups at that size.
+ *     spawn     Compare fork+exec with posix_spawn of /bin/true from a
+ *               parent of increasing RSS, the cost tsh -s avoids.
+ *     pipe      Push <count> MB through a four-stage pipeline run by tsh
+ *               and by /bin/sh, and check that tsh itself stays idle
+ *               (no CPU time, no wakeups beyond reaping the stages).
+ *     cat       Copy a <count> MB file with the cat builtin and with
+ *               /bin/cat, into a file and into a pipe, and report MB/s.
+ *     script    Run a <count>-line script of builtins with a trivial
+ *               command every 100 lines, as a script file and fed
+ *               through a pipe with -p, and report lines per second.
+ *     trace     Replay the command lines of trace15.txt (less the driver
+ *               directives and background jobs) for <count> lines with
+ *               echo run inside the shell and, with -E, as /bin/echo,
+ *               and report commands per second.
+ *     jtop      Hold <count> background jobs and run 100 jtop samples,
+ *               then report the CPU time the shell spent per sample,
+ *               next to the cost of reading the same /proc files from
+ *               fds kept open and opened anew for every sample.
+ *     pidwrap   In a PID namespace of its own (needs root), force PIDs
+ *               to be reused <count> times through ns_last_pid: by a
+ *               new job right after the shell reaped the old one, and by
+ *               an unrelated process, which job control on the dead job
+ *               must not touch.
+ *     affinity  With the shell pinned to one CPU, run <count> CPU-bound
+ *               background jobs (one per online CPU, at least two, by
+ *               default) as they inherit its affinity and with spread
+ *               cpu, and report how long they took and the speedup.
+ *     burn      Spin for BURNITERS iterations; the affinity mode's job.
+ *     parallel  Queue <count> "./myspin 0" tasks for the parallel builtin
+ *               with -j 1, one slot per CPU and four per CPU, and report
+ *               the makespan and how busy that kept the CPUs.
+ *     dag       Run a diamond of after jobs <count> wide, each sleeping
+ *               DAGSTEP, and check that it takes its critical path (three
+ *               steps) rather than one step per job; then, in a new
+ *               shell, make the first job fail once the others wait for
+ *               it, and check that each of them is reported not run.
+ *     zygote    Time <count> foreground "/bin/sleep 0" commands (true is
+ *               a builtin) launched by fork, by posix_spawn (-s) and by
+ *               the zygote (-z), with 0 and ZYGOTEJOBS jobs held, and
+ *               check that the zygote's children are reaped by the shell.
+ *     lifecycle Run <count> foreground "/bin/sleep 0" commands with the
+ *               shell's trace off and on, then read its binary dump,
+ *               check that every child has a fork, exec and reap event
+ *               and report where the time of a command went.
+ *     signals   Run the shell on a pty with a catch job in the foreground
+ *               and type <count> ctrl-c and ctrl-z one at a time, timing
+ *               each from the keystroke to the job and, through the
+ *               shell's trace, from the shell to the job; then <count>/10
+ *               ctrl-z/fg cycles that really stop the job and a storm of
+ *               STORMSIGS keystrokes, and check that the job still gets
+ *               signals, leaves the job list clean and leaves no zombie.
+ *     capture   With the shell's capture on (-o), run CAPTUREJOBS
+ *               background jobs that print <count> MB each, and report
+ *               how fast the shell takes their output in, what that
+ *               costs it and how much it grows (no more than a ring per
+ *               job); then check that jobs -o shows the last CAPTURECAP
+ *               bytes of a job that printed more, and says how many it
+ *               dropped.
+ *     catch     Count and timestamp SIGINT, SIGTSTP and SIGCONT in the
+ *               file of the signals mode; the signals mode's job.
+ */
+#define _GNU_SOURCE /* for unshare */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> /* for __rdtsc */
+#endif
+
+#include "tshtrace.h"
+
+#define MAXBUF 8192 /* shell output buffer */
+#define JTOPSAMPLES 100 /* samples taken by the jtop mode */
+#define BURNITERS 100000000L /* iterations of the burn mode */
+#define DAGSTEP 0.25 /* seconds each job of the dag mode sleeps */
+#define ZYGOTEJOBS 1000 /* jobs held by the zygote mode's large shell */
+
+#define SIGSAMPLES 100000 /* arrivals the catch job timestamps, per signal */
+#define STORMSIGS 10000   /* keystrokes typed by the signals mode's storm */
+#define SIGWAIT 1000000   /* us the signals mode waits for an arrival */
+
+#define CAPTUREJOBS 16     /* jobs printing at once in the capture mode */
+#define CAPTURESLACK 4096  /* KB the shell may grow by beyond the rings */
+
+/* Shared by the signals mode and its catch job, through a file */
+struct sigmap_t
+{
+    volatile int ready;    /* the job's handlers are in place */
+    volatile int quit;     /* the job is to exit at the next SIGINT */
+    volatile int stopmode; /* SIGTSTP is to stop the job */
+    volatile int mode;     /* stopmode, once the job has applied it */
+    volatile long n[3];    /* SIGINTs, SIGTSTPs and SIGCONTs that arrived */
+    volatile double us[3]; /* now_us() at the last of each */
+    uint64_t at[2][SIGSAMPLES]; /* trace clock at each SIGINT and SIGTSTP */
+};
+struct sigmap_t *sigmap; /* in the signals mode and the catch job */
+
+char prompt[] = "tsh> "; /* the prompt we synchronize on */
+char *shell = "./tsh";   /* shell under test */
+char *shellarg = NULL;   /* extra argument for the shell (e.g. "-s") */
+char *command = "/bin/true"; /* command timed by the latency mode */
+int count = 0;           /* number of samples (0: mode default) */
+int preload = 0;         /* background jobs held during latency runs */
+
+/* A running shell and the pipes that connect us to it */
+struct shell_t
+{
+    pid_t pid;
+    int in;  /* we write commands here */
+    int out; /* we read its output here */
+};
+
+void usage(void);
+void unix_error(char *msg);
+void app_error(char *msg);
+
+void start_shell(struct shell_t *sh, char *args);
+void stop_shell(struct shell_t *sh);
+void send_line(struct shell_t *sh, const char *line);
+int wait_prompt(struct shell_t *sh, const char *word, char *last);
+int count_zombies(pid_t parent);
+void load_jobs(struct shell_t *sh, int n);
+void unload_jobs(struct shell_t *sh, int n);
+double now_us(void);
+int cmp_double(const void *a, const void *b);
+void report(const char *what, double *samples, int n);
+
+void bench_latency(void);
+void bench_reap(void);
+void bench_jobs(void);
+void bench_spawn(void);
+void bench_pipe(void);
+void bench_cat(void);
+void bench_script(void);
+void bench_trace(void);
+void bench_jtop(void);
+void bench_pidwrap(void);
+void bench_affinity(void);
+void bench_parallel(void);
+void bench_dag(void);
+void bench_zygote(void);
+void bench_lifecycle(void);
+void bench_signals(void);
+void bench_capture(void);
+void catch_signals(const char *path);
+void catch_handler(int sig);
+uint64_t trace_clock(void);
+void start_pty_shell(struct shell_t *sh, char *args);
+int type_key(struct shell_t *sh, char key, int k, double *us);
+void map_signals(const char *path, int create);
+double *run_traced(int on, double *samples);
+double run_dag(struct shell_t *sh, const char *first);
+int start_dag(struct shell_t *sh, const char *first);
+double run_burners(struct shell_t *sh, const char *self, int n);
+void pidwrap_ns(void);
+pid_t start_job(struct shell_t *sh, const char *line, int *jid);
+void wait_gone(pid_t pid);
+void set_last_pid(pid_t pid);
+double run_script(const char *script, int piped);
+double time_line(struct shell_t *sh, const char *line);
+void proc_usage(pid_t pid, double *cpu_ms, long *ctxsw);
+long proc_rss(pid_t pid);
+
+int main(int argc, char **argv)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "hs:a:c:n:j:")) != EOF)
+    {
+        switch (c)
+        {
+        case 's':
+            shell = optarg;
+            break;
+        case 'a':
+            shellarg = optarg;
+            break;
+        case 'c':
+            command = optarg;
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'j':
+            preload = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind >= argc || count < 0)
+        usage();
+
+    signal(SIGPIPE, SIG_IGN);
+    if (!strcmp(argv[optind], "latency"))
+        bench_latency();
+    else if (!strcmp(argv[optind], "reap"))
+        bench_reap();
+    else if (!strcmp(argv[optind], "jobs"))
+        bench_jobs();
+    else if (!strcmp(argv[optind], "spawn"))
+        bench_spawn();
+    else if (!strcmp(argv[optind], "pipe"))
+        bench_pipe();
+    else if (!strcmp(argv[optind], "cat"))
+        bench_cat();
+    else if (!strcmp(argv[optind], "script"))
+        bench_script();
+    else if (!strcmp(argv[optind], "trace"))
+        bench_trace();
+    else if (!strcmp(argv[optind], "jtop"))
+        bench_jtop();
+    else if (!strcmp(argv[optind], "pidwrap"))
+        bench_pidwrap();
+    else if (!strcmp(argv[optind], "affinity"))
+        bench_affinity();
+    else if (!strcmp(argv[optind], "parallel"))
+        bench_parallel();
+    else if (!strcmp(argv[optind], "dag"))
+        bench_dag();
+    else if (!strcmp(argv[optind], "zygote"))
+        bench_zygote();
+    else if (!strcmp(argv[optind], "lifecycle"))
+        bench_lifecycle();
+    else if (!strcmp(argv[optind], "signals"))
+        bench_signals();
+    else if (!strcmp(argv[optind], "capture"))
+        bench_capture();
+    else if (!strcmp(argv[optind], "catch") && optind + 1 < argc)
+        catch_signals(argv[optind + 1]);
+    else if (!strcmp(argv[optind], "burn"))
+    {
+        volatile long spin;
+        for (spin = 0; spin < BURNITERS; spin++)
+            ;
+    }
+    else
+        usage();
+    exit(0);
+}
+
+/*
+ * bench_latency - Time the turnaround of trivial foreground commands,
+ *     from the moment the line is written until the next prompt.
+ */
+void bench_latency(void)
+{
+    struct shell_t sh;
+    char line[MAXBUF];
+    double *samples, t0;
+    int i;
+
+    if (!count)
+        count = 5000;
+    snprintf(line, sizeof(line), "%s\n", command);
+    if ((samples = malloc(count * sizeof(double))) == NULL)
+        unix_error("malloc error");
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    load_jobs(&sh, preload);
+    for (i = 0; i < count; i++)
+    {
+        t0 = now_us();
+        send_line(&sh, line);
+        wait_prompt(&sh, NULL, NULL);
+        samples[i] = now_us() - t0;
+    }
+    unload_jobs(&sh, preload);
+    stop_shell(&sh);
+
+    snprintf(line, sizeof(line), "%s turnaround%s", command,
+             preload ? " (with -j)" : "");
+    report(line, samples, count);
+    free(samples);
+}
+
+/*
+ * bench_reap - Fan out background jobs, then kill them all at once so
+ *     their SIGCHLDs coalesce, and check for leaked zombies and jobs.
+ */
+void bench_reap(void)
+{
+    struct shell_t sh;
+    char line[MAXBUF];
+    pid_t *pids;
+    int i, zombies, reported, leaked;
+    double t0;
+
+    if (!count)
+        count = 300;
+    if ((pids = malloc(count * sizeof(pid_t))) == NULL)
+        unix_error("malloc error");
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    t0 = now_us();
+    for (i = 0; i < count; i++)
+    {
+        send_line(&sh, "./myspin 100 &\n");
+        if (wait_prompt(&sh, "./myspin", line) != 1 ||
+            sscanf(line, "[%*d] (%d)", &pids[i]) != 1)
+            app_error("background job was not started");
+    }
+    printf("launched %d jobs in %.1fms\n", count, (now_us() - t0) / 1e3);
+
+    /* alternate signals so every kind of death gets reported */
+    for (i = 0; i < count; i++)
+        kill(pids[i], (i & 1) ? SIGKILL : SIGTERM);
+    sleep(1);
+
+    zombies = count_zombies(sh.pid);
+    send_line(&sh, "jobs\n");
+    reported = 0;
+    do
+    { /* reports may straddle the prompt of the previous command */
+        reported += wait_prompt(&sh, "terminated by signal", NULL);
+        send_line(&sh, "jobs\n");
+    } while (reported < count && reported > 0);
+    leaked = wait_prompt(&sh, "Running", NULL);
+    stop_shell(&sh);
+    free(pids);
+
+    printf("zombies left: %d, jobs left: %d, deaths reported: %d/%d\n",
+           zombies, leaked, reported, count);
+    if (zombies || leaked || reported != count)
+        app_error("FAIL: children leaked");
+    printf("PASS\n");
+}
+
+/*
+ * bench_jobs - Time job list lookups with <count> jobs in the list.
+ *     Each bg looks the job up by JID and each kill also deletes it.
+ */
+void bench_jobs(void)
+{
+    struct shell_t sh;
+    char line[MAXBUF];
+    double *samples, t0;
+    int i, j, tmp, *order;
+
+    if (!count)
+        count = 2000;
+    if ((samples = malloc(count * sizeof(double))) == NULL ||
+        (order = malloc(count * sizeof(int))) == NULL)
+        unix_error("malloc error");
+    for (i = 0; i < count; i++)
+        order[i] = i + 1;
+    srand(1);
+    for (i = count - 1; i > 0; i--)
+    { /* visit the JIDs in random order */
+        j = rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    load_jobs(&sh, count);
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf(line, "bg %%%d\n", order[i]);
+        t0 = now_us();
+        send_line(&sh, line);
+        if (wait_prompt(&sh, "sleep", NULL) != 1)
+            app_error("bg did not find the job");
+        samples[i] = now_us() - t0;
+    }
+    sprintf(line, "bg %%jid with %d jobs", count);
+    report(line, samples, count);
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf(line, "kill %%%d\n", order[i]);
+        t0 = now_us();
+        send_line(&sh, line);
+        wait_prompt(&sh, NULL, NULL);
+        samples[i] = now_us() - t0;
+    }
+    sprintf(line, "kill %%jid from %d jobs", count);
+    report(line, samples, count);
+
+    stop_shell(&sh);
+    free(samples);
+    free(order);
+}
+
+/*
+ * bench_spawn - Launch rate of fork+exec and posix_spawn from this
+ *     process while it holds 0, 64, 256 and 1024 MB of touched memory,
+ *     standing in for a shell with a large heap.
+ */
+void bench_spawn(void)
+{
+    static int sizes[] = {0, 64, 256, 1024};
+    char *argv[] = {"/bin/true", NULL}, *ballast;
+    extern char **environ;
+    double t0, rate_fork, rate_spawn;
+    size_t bytes;
+    pid_t pid;
+    int i, k;
+
+    if (!count)
+        count = 1000;
+    for (k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++)
+    {
+        bytes = (size_t)sizes[k] << 20;
+        if (bytes && (ballast = malloc(bytes)) == NULL)
+            unix_error("malloc error");
+        if (bytes)
+            memset(ballast, 1, bytes); /* make it resident */
+
+        t0 = now_us();
+        for (i = 0; i < count; i++)
+        {
+            if ((pid = fork()) == 0)
+            {
+                setpgid(0, 0);
+                execve(argv[0], argv, environ);
+                _exit(1);
+            }
+            waitpid(pid, NULL, 0);
+        }
+        rate_fork = count / ((now_us() - t0) / 1e6);
+
+        t0 = now_us();
+        for (i = 0; i < count; i++)
+        {
+            posix_spawnattr_t attr;
+
+            posix_spawnattr_init(&attr);
+            posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+            posix_spawnattr_setpgroup(&attr, 0);
+            if (posix_spawn(&pid, argv[0], NULL, &attr, argv, environ))
+                app_error("posix_spawn error");
+            posix_spawnattr_destroy(&attr);
+            waitpid(pid, NULL, 0);
+        }
+        rate_spawn = count / ((now_us() - t0) / 1e6);
+
+        printf("RSS +%4d MB: fork %6.0f cmds/s, posix_spawn %6.0f cmds/s\n",
+               sizes[k], rate_fork, rate_spawn);
+        if (bytes)
+            free(ballast);
+    }
+}
+
+/*
+ * bench_pipe - Time a four-stage pipeline moving <count> MB through tsh
+ *     and through /bin/sh. The data never passes through the shell, so
+ *     tsh should use no CPU while it waits and wake up only to reap.
+ */
+void bench_pipe(void)
+{
+    struct shell_t sh;
+    char line[MAXBUF], last[MAXBUF];
+    double t0, t_tsh, t_sh, cpu0, cpu1;
+    long ctx0, ctx1, bytes;
+    pid_t pid;
+
+    if (!count)
+        count = 2048;
+    snprintf(line, sizeof(line), "head -c %dM /dev/zero | cat | cat | wc -c\n",
+             count);
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    proc_usage(sh.pid, &cpu0, &ctx0);
+    t0 = now_us();
+    send_line(&sh, line);
+    if (wait_prompt(&sh, NULL, last) != 1 || sscanf(last, "%ld", &bytes) != 1)
+        app_error("pipeline produced no count");
+    t_tsh = (now_us() - t0) / 1e6;
+    proc_usage(sh.pid, &cpu1, &ctx1);
+    stop_shell(&sh);
+    if (bytes != (long)count << 20)
+        app_error("FAIL: pipeline lost data");
+
+    line[strlen(line) - 1] = '\0';
+    t0 = now_us();
+    if ((pid = fork()) == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        execl("/bin/sh", "sh", "-c", line, (char *)NULL);
+        _exit(1);
+    }
+    waitpid(pid, NULL, 0);
+    t_sh = (now_us() - t0) / 1e6;
+
+    printf("%d MB through 4 stages: tsh %.2fs (%.0f MB/s), sh %.2fs (%.0f MB/s)\n",
+           count, t_tsh, count / t_tsh, t_sh, count / t_sh);
+    printf("tsh while waiting: cpu %.1fms, %ld context switches\n",
+           cpu1 - cpu0, ctx1 - ctx0);
+    if (ctx1 - ctx0 > 16)
+        app_error("FAIL: the shell woke up more than reaping needs");
+    printf("PASS\n");
+}
+
+/*
+ * bench_cat - Copy a <count> MB file through tsh, with the in-shell cat
+ *     builtin and with /bin/cat, once into a file and once into a FIFO
+ *     drained by a reader process.
+ */
+void bench_cat(void)
+{
+    static char buf[1 << 20];
+    char *in = "/tmp/tshbench.in", *out = "/tmp/tshbench.out";
+    char *fifo = "/tmp/tshbench.fifo", *dest[] = {out, fifo};
+    char *cat[] = {"cat", "/bin/cat"};
+    char line[MAXBUF];
+    struct shell_t sh;
+    double secs;
+    pid_t reader = 0;
+    int i, d, c, fd;
+
+    if (!count)
+        count = 1024;
+    if ((fd = open(in, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        unix_error("open error");
+    memset(buf, 'x', sizeof(buf));
+    for (i = 0; i < count; i++)
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+            unix_error("write error");
+    close(fd);
+    unlink(fifo);
+    if (mkfifo(fifo, 0600) < 0)
+        unix_error("mkfifo error");
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    for (d = 0; d < 2; d++)
+    {
+        for (c = 0; c < 2; c++)
+        {
+            if (dest[d] == fifo && (reader = fork()) == 0)
+            {
+                if ((fd = open(fifo, O_RDONLY)) < 0)
+                    unix_error("open error");
+                while (read(fd, buf, sizeof(buf)) > 0)
+                    ;
+                _exit(0);
+            }
+            snprintf(line, sizeof(line), "%s %s > %s\n", cat[c], in, dest[d]);
+            secs = time_line(&sh, line);
+            if (reader)
+                waitpid(reader, NULL, 0);
+            printf("%-8s into a %-4s: %d MB in %.3fs, %.0f MB/s\n", cat[c],
+                   dest[d] == fifo ? "pipe" : "file", count, secs, count / secs);
+        }
+    }
+    stop_shell(&sh);
+    unlink(in);
+    unlink(out);
+    unlink(fifo);
+}
+
+/*
+ * bench_script - Time a <count>-line script: mostly the jobs, hash and
+ *     export builtins, which only write to the output buffer, and
+ *     /bin/true every 100 lines, which flushes it.
+ */
+void bench_script(void)
+{
+    char *script = "/tmp/tshbench.tsh";
+    double secs;
+    FILE *fp;
+    int i, piped;
+
+    if (!count)
+        count = 100000;
+    if ((fp = fopen(script, "w")) == NULL)
+        unix_error("fopen error");
+    for (i = 0; i < count; i++)
+    {
+        if (i % 100 == 99)
+            fprintf(fp, "/bin/true\n");
+        else if (i % 10 == 9)
+            fprintf(fp, "hash\n");
+        else if (i % 2)
+            fprintf(fp, "jobs\n");
+        else
+            fprintf(fp, "export TSHBENCH=%d\n", i);
+    }
+    fclose(fp);
+
+    for (piped = 0; piped < 2; piped++)
+    {
+        secs = run_script(script, piped);
+        printf("%d lines, %-14s: %.3fs, %.0f lines/s\n", count,
+               piped ? "-p from a pipe" : "script file", secs, count / secs);
+    }
+    unlink(script);
+}
+
+/*
+ * bench_trace - Run the command lines of trace15.txt over and over for
+ *     <count> lines, in the shell as it is and with -E, which makes
+ *     every /bin/echo a fork and exec again.
+ */
+void bench_trace(void)
+{
+    char *trace = "trace15.txt", *script = "/tmp/tshbench.tsh";
+    char lines[64][MAXBUF], *args[2] = {NULL, "-E"};
+    int i, n = 0, len, k;
+    double secs[2];
+    FILE *in, *out;
+
+    if (!count)
+        count = 10000;
+    if ((in = fopen(trace, "r")) == NULL)
+        unix_error("fopen error");
+    while (n < 64 && fgets(lines[n], MAXBUF, in))
+    { /* drop comments, driver directives and background jobs */
+        len = strlen(lines[n]);
+        if (len > 1 && lines[n][0] != '#' && !isupper((unsigned char)lines[n][0]) &&
+            lines[n][len - 2] != '&')
+            n++;
+    }
+    fclose(in);
+    if (n == 0)
+        app_error("no command lines in trace15.txt");
+    if ((out = fopen(script, "w")) == NULL)
+        unix_error("fopen error");
+    for (i = 0; i < count; i++)
+        fputs(lines[i % n], out);
+    fclose(out);
+
+    for (k = 0; k < 2; k++)
+    {
+        shellarg = args[k];
+        secs[k] = run_script(script, 0);
+        printf("%d lines of %s, %-17s: %.3fs, %.0f cmds/s\n", count, trace,
+               k ? "-E (/bin/echo)" : "in-process echo", secs[k], count / secs[k]);
+    }
+    printf("speedup: %.1fx\n", secs[1] / secs[0]);
+    unlink(script);
+}
+
+/*
+ * bench_jtop - Time jtop's sampler on <count> jobs: the shell's CPU time
+ *     over JTOPSAMPLES samples (printing included), and what reading the
+ *     same stat and statm files costs alone, kept open and opened anew
+ *     for every sample.
+ */
+void bench_jtop(void)
+{
+    struct shell_t sh;
+    char line[MAXBUF], path[64], buf[MAXBUF], *p, *end;
+    double cpu0, cpu1, t0, t_jtop, t_open, t_cached;
+    pid_t *pids;
+    long ctx0, ctx1, pid;
+    int i, k, fd, *fds, n = 0, lines;
+    ssize_t got;
+
+    if (!count)
+        count = 300;
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    load_jobs(&sh, count);
+
+    proc_usage(sh.pid, &cpu0, &ctx0);
+    t0 = now_us();
+    snprintf(line, sizeof(line), "jtop -n %d -d 0.01\n", JTOPSAMPLES);
+    send_line(&sh, line);
+    lines = wait_prompt(&sh, "Running", NULL);
+    t_jtop = (now_us() - t0) / 1e3;
+    proc_usage(sh.pid, &cpu1, &ctx1);
+    if (lines != JTOPSAMPLES * count)
+        app_error("FAIL: jtop did not show every job in every sample");
+
+    /* the same processes, with the files opened for every sample */
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int)sh.pid,
+             (int)sh.pid);
+    if ((pids = malloc(count * sizeof(pid_t))) == NULL)
+        unix_error("malloc error");
+    if ((fd = open(path, O_RDONLY)) < 0)
+        unix_error("open error");
+    got = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    buf[got > 0 ? got : 0] = '\0';
+    for (p = buf; n < count && (pid = strtol(p, &end, 10)) > 0; p = end)
+        pids[n++] = (pid_t)pid;
+    t0 = now_us();
+    for (k = 0; k < JTOPSAMPLES; k++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            snprintf(path, sizeof(path), "/proc/%d/stat", (int)pids[i]);
+            if ((fd = open(path, O_RDONLY)) >= 0)
+            {
+                if (read(fd, buf, sizeof(buf)) < 0)
+                    unix_error("read error");
+                close(fd);
+            }
+            snprintf(path, sizeof(path), "/proc/%d/statm", (int)pids[i]);
+            if ((fd = open(path, O_RDONLY)) >= 0)
+            {
+                if (read(fd, buf, sizeof(buf)) < 0)
+                    unix_error("read error");
+                close(fd);
+            }
+        }
+    }
+    t_open = (now_us() - t0) / 1e3;
+
+    /* and kept open, as jtop does */
+    if ((fds = malloc(2 * n * sizeof(int))) == NULL)
+        unix_error("malloc error");
+    for (i = 0; i < n; i++)
+    {
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pids[i]);
+        fds[2 * i] = open(path, O_RDONLY);
+        snprintf(path, sizeof(path), "/proc/%d/statm", (int)pids[i]);
+        fds[2 * i + 1] = open(path, O_RDONLY);
+    }
+    t0 = now_us();
+    for (k = 0; k < JTOPSAMPLES; k++)
+        for (i = 0; i < 2 * n; i++)
+            if (fds[i] >= 0 && pread(fds[i], buf, sizeof(buf), 0) < 0)
+                unix_error("pread error");
+    t_cached = (now_us() - t0) / 1e3;
+    for (i = 0; i < 2 * n; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    free(fds);
+    free(pids);
+    unload_jobs(&sh, count);
+    stop_shell(&sh);
+
+    printf("jtop, %d jobs, %d samples in %.0fms: shell cpu %.2fms/sample "
+           "(%.1fus/job), %.2f%% of a CPU at 1 Hz\n",
+           count, JTOPSAMPLES, t_jtop, (cpu1 - cpu0) / JTOPSAMPLES,
+           (cpu1 - cpu0) * 1e3 / JTOPSAMPLES / count,
+           (cpu1 - cpu0) / JTOPSAMPLES / 10);
+    printf("reading the same files alone: kept open %.2fms/sample (%.1fus/job), "
+           "opened each time %.2fms/sample (%.1fus/job)\n",
+           t_cached / JTOPSAMPLES, t_cached * 1e3 / JTOPSAMPLES / n,
+           t_open / JTOPSAMPLES, t_open * 1e3 / JTOPSAMPLES / n);
+}
+
+/*
+ * bench_affinity - Pin ourselves (and so the shell) to our first CPU,
+ *     then time <count> burn jobs started in the background, left on
+ *     that CPU and spread over the online ones.
+ */
+void bench_affinity(void)
+{
+    struct shell_t sh;
+    char self[4096], buf[MAXBUF];
+    cpu_set_t set;
+    double t_inherit, t_spread;
+    ssize_t len;
+    int cpu, ncpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if ((len = readlink("/proc/self/exe", self, sizeof(self) - 1)) < 0)
+        unix_error("readlink error");
+    self[len] = '\0';
+    if (!count)
+        count = ncpus > 2 ? ncpus : 2;
+    if (sched_getaffinity(0, sizeof(set), &set) < 0)
+        unix_error("sched_getaffinity error");
+    for (cpu = 0; !CPU_ISSET(cpu, &set); cpu++)
+        ;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+        unix_error("sched_setaffinity error");
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    t_inherit = run_burners(&sh, self, count);
+    send_line(&sh, "spread cpu\n");
+    wait_prompt(&sh, NULL, NULL);
+    t_spread = run_burners(&sh, self, count);
+    send_line(&sh, "spread\n");
+    if (wait_prompt(&sh, "0 jobs", buf) != ncpus)
+        app_error("FAIL: spread still counts jobs that are gone");
+    stop_shell(&sh);
+
+    printf("affinity, %d burn jobs on %d online CPUs, shell on CPU %d: "
+           "inherited %.0fms, spread cpu %.0fms, speedup %.2fx\n",
+           count, ncpus, cpu, t_inherit, t_spread, t_inherit / t_spread);
+}
+
+/*
+ * run_burners - Start n burn jobs in the background and wait (polling
+ *     jobs) until none of them is running. Returns the time in ms.
+ */
+double run_burners(struct shell_t *sh, const char *self, int n)
+{
+    char line[MAXBUF];
+    struct timespec ts = {0, 10000000}; /* 10ms */
+    double t0 = now_us();
+    int i;
+
+    snprintf(line, sizeof(line), "%s burn &\n", self);
+    for (i = 0; i < n; i++)
+    {
+        send_line(sh, line);
+        if (wait_prompt(sh, "burn", NULL) != 1)
+            app_error("background job was not started");
+    }
+    do
+    {
+        nanosleep(&ts, NULL);
+        send_line(sh, "jobs\n");
+    } while (wait_prompt(sh, "Running", NULL) > 0);
+    return (now_us() - t0) / 1e3;
+}
+
+/*
+ * bench_parallel - Run a queue of <count> trivial tasks through the
+ *     parallel builtin, each time in a new shell, so that what it and
+ *     its jobs used is our RUSAGE_CHILDREN once it is reaped.
+ */
+void bench_parallel(void)
+{
+    char *queue = "/tmp/tshbench.queue", line[MAXBUF];
+    struct shell_t sh;
+    struct rusage ru0, ru1;
+    cpu_set_t set;
+    double t0, makespan, cpu;
+    int i, k, ncpus, slots[3];
+    FILE *fp;
+
+    if (!count)
+        count = 10000;
+    ncpus = sched_getaffinity(0, sizeof(set), &set) == 0 ? CPU_COUNT(&set) : 1;
+    slots[0] = 1;
+    slots[1] = ncpus;
+    slots[2] = 4 * ncpus;
+    if ((fp = fopen(queue, "w")) == NULL)
+        unix_error("fopen error");
+    for (i = 0; i < count; i++)
+        fprintf(fp, "./myspin 0\n");
+    fclose(fp);
+
+    for (k = 0; k < 3; k++)
+    {
+        if (k > 0 && slots[k] == slots[k - 1])
+            continue; /* one CPU */
+        getrusage(RUSAGE_CHILDREN, &ru0);
+        start_shell(&sh, shellarg);
+        wait_prompt(&sh, NULL, NULL);
+        snprintf(line, sizeof(line), "parallel -j %d %s\n", slots[k], queue);
+        t0 = now_us();
+        send_line(&sh, line);
+        if (wait_prompt(&sh, NULL, NULL) != 0)
+            app_error("FAIL: parallel printed something");
+        makespan = (now_us() - t0) / 1e6;
+        send_line(&sh, "jobs\n");
+        if (wait_prompt(&sh, NULL, NULL) != 0)
+            app_error("FAIL: parallel returned with jobs left");
+        stop_shell(&sh);
+        getrusage(RUSAGE_CHILDREN, &ru1);
+        cpu = ru1.ru_utime.tv_sec - ru0.ru_utime.tv_sec +
+              ru1.ru_stime.tv_sec - ru0.ru_stime.tv_sec +
+              (ru1.ru_utime.tv_usec - ru0.ru_utime.tv_usec +
+               ru1.ru_stime.tv_usec - ru0.ru_stime.tv_usec) / 1e6;
+        printf("parallel -j %-3d %d tasks: makespan %.2fs, %.0f tasks/s, "
+               "cpu %.2fs, %.0f%% of %d CPUs\n", slots[k], count, makespan,
+               count / makespan, cpu, 100 * cpu / makespan / ncpus, ncpus);
+    }
+    unlink(queue);
+}
+
+/*
+ * bench_dag - Time a wide diamond of jobs against its critical path;
+ *     then, in a fresh shell (so no JID has a fate yet), one whose first
+ *     job fails after DAGSTEP, and check from the output that every
+ *     other job was dropped.
+ */
+void bench_dag(void)
+{
+    struct shell_t sh;
+    char first[64];
+    double path = 3 * DAGSTEP, t_ok, t_fail, t0;
+    int failed;
+
+    if (!count)
+        count = 50;
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    snprintf(first, sizeof(first), "/bin/sleep %g", DAGSTEP);
+    t_ok = run_dag(&sh, first);
+    stop_shell(&sh);
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    snprintf(first, sizeof(first), "./myload -s %d -x 1", (int)(DAGSTEP * 1e3));
+    t0 = now_us();
+    failed = start_dag(&sh, first);
+    while (failed < count + 1 && now_us() - t0 < (count + 2) * DAGSTEP * 1e6)
+    {
+        usleep(5000);
+        send_line(&sh, "jobs\n");
+        failed += wait_prompt(&sh, "failed", NULL);
+    }
+    t_fail = (now_us() - t0) / 1e6;
+    stop_shell(&sh);
+
+    printf("dag, 1 + %d + 1 jobs of %.2fs: %.3fs, critical path %.2fs "
+           "(+%.0fms), %.2fs one at a time\n", count, DAGSTEP, t_ok, path,
+           (t_ok - path) * 1e3, (count + 2) * DAGSTEP);
+    printf("dag with a first job failing after %.2fs: %d of %d jobs not run "
+           "after %.3fs\n", DAGSTEP, failed, count + 1, t_fail);
+    if (t_ok < path || t_ok >= (count + 2) * DAGSTEP / 2)
+        app_error("FAIL: the diamond did not run along its critical path");
+    if (failed != count + 1)
+        app_error("FAIL: jobs ran after a job they depend on failed");
+    printf("PASS\n");
+}
+
+/*
+ * run_dag - Start a diamond with start_dag and poll jobs until the list
+ *     is empty. Returns the time in seconds.
+ */
+double run_dag(struct shell_t *sh, const char *first)
+{
+    struct timespec ts = {0, 5000000}; /* 5ms */
+    double t0 = now_us();
+
+    start_dag(sh, first);
+    do
+    {
+        nanosleep(&ts, NULL);
+        send_line(sh, "jobs\n");
+    } while (wait_prompt(sh, "] (", NULL) > 0);
+    return (now_us() - t0) / 1e6;
+}
+
+/*
+ * start_dag - Start first in the background, <count> jobs after it and
+ *     one after all of those. Returns the number of lines meanwhile
+ *     that said a job failed (or won't run because one did).
+ */
+int start_dag(struct shell_t *sh, const char *first)
+{
+    char line[MAXBUF], *p;
+    int i, failed;
+
+    snprintf(line, sizeof(line), "%s &\n", first);
+    send_line(sh, line);
+    failed = wait_prompt(sh, "failed", NULL);
+    snprintf(line, sizeof(line), "after %%1 -- /bin/sleep %g &\n", DAGSTEP);
+    for (i = 0; i < count; i++)
+    {
+        send_line(sh, line);
+        failed += wait_prompt(sh, "failed", NULL);
+    }
+    p = line + sprintf(line, "after");
+    for (i = 0; i < count && p < line + sizeof(line) - 64; i++)
+        p += sprintf(p, " %%%d", i + 2);
+    sprintf(p, " -- /bin/sleep %g &\n", DAGSTEP);
+    send_line(sh, line);
+    failed += wait_prompt(sh, "failed", NULL);
+    return failed;
+}
+
+/*
+ * bench_zygote - Foreground turnaround of a real program started each
+ *     of the three ways, from a small shell and from one holding
+ *     ZYGOTEJOBS jobs, which is what fork pays for.
+ */
+void bench_zygote(void)
+{
+    static char *args[] = {NULL, "-s", "-z"};
+    static char *names[] = {"fork", "posix_spawn", "zygote"};
+    struct shell_t sh;
+    char what[128];
+    double *samples, t0;
+    int i, k, held;
+
+    if (!count)
+        count = 1000;
+    if ((samples = malloc(count * sizeof(double))) == NULL)
+        unix_error("malloc error");
+    for (held = 0; held <= ZYGOTEJOBS; held += ZYGOTEJOBS)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            start_shell(&sh, args[k]);
+            wait_prompt(&sh, NULL, NULL);
+            load_jobs(&sh, held);
+            for (i = 0; i < count; i++)
+            {
+                t0 = now_us();
+                send_line(&sh, "/bin/sleep 0\n");
+                wait_prompt(&sh, NULL, NULL);
+                samples[i] = now_us() - t0;
+            }
+            if (count_zombies(sh.pid))
+                app_error("FAIL: the shell left children unreaped");
+            unload_jobs(&sh, held);
+            stop_shell(&sh);
+            snprintf(what, sizeof(what), "%-11s %4d jobs held", names[k], held);
+            report(what, samples, count);
+        }
+    }
+    free(samples);
+}
+
+/*
+ * bench_lifecycle - The trace's cost on a real command, and what it
+ *     shows: per command, parse to fork (eval), fork to exec (the child
+ *     getting going), exec to reap (the program, then the exit reaching
+ *     the shell) and reap to the return of waitfg.
+ */
+void bench_lifecycle(void)
+{
+    static char *names[] = {"parse->fork", "fork->exec", "exec->reap",
+                            "reap->fg done"};
+    struct trevent_t *ev;
+    double *samples, *stage[4], nspertick;
+    char path[64], magic[8], what[64];
+    uint64_t hdr[2], parse = 0;
+    int i, j, k, n[4] = {0, 0, 0, 0}, forks = 0, execs = 0, reaps = 0;
+    FILE *fp;
+
+    if (!count)
+        count = 1000;
+    if ((samples = malloc(count * sizeof(double))) == NULL)
+        unix_error("malloc error");
+    for (k = 0; k < 4; k++)
+        if ((stage[k] = malloc(count * sizeof(double))) == NULL)
+            unix_error("malloc error");
+    report("trace off", run_traced(0, samples), count);
+    report("trace on ", run_traced(1, samples), count);
+
+    snprintf(path, sizeof(path), "/tmp/tshbench.%d.trace", (int)getpid());
+    if ((fp = fopen(path, "r")) == NULL)
+        unix_error(path);
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, "TSHTRACE", 8) ||
+        fread(&nspertick, sizeof(nspertick), 1, fp) != 1 ||
+        fread(hdr, sizeof(hdr), 1, fp) != 1)
+        app_error("FAIL: bad trace dump");
+    if ((ev = malloc(hdr[1] * sizeof(*ev) + 1)) == NULL)
+        unix_error("malloc error");
+    if (fread(ev, sizeof(*ev), hdr[1], fp) != hdr[1])
+        app_error("FAIL: short trace dump");
+    fclose(fp);
+    unlink(path);
+
+    /* the events come by process, then time: the shell's (pid 0) first */
+    for (i = 0; i < (int)hdr[1]; i++)
+    {
+        forks += ev[i].type == TR_FORK;
+        execs += ev[i].type == TR_EXEC;
+        reaps += ev[i].type == TR_REAP;
+    }
+    for (i = 0; i < (int)hdr[1] && ev[i].pid == 0; i++)
+        ;
+    for (j = 0; i < (int)hdr[1]; i += 4)
+    {
+        /* a child's fork, exec, reap and fg done, and the shell's parse
+         * before its fork */
+        if (i + 3 >= (int)hdr[1] || ev[i].type != TR_FORK ||
+            ev[i + 1].type != TR_EXEC || ev[i + 2].type != TR_REAP ||
+            ev[i + 3].type != TR_FGDONE || ev[i + 3].pid != ev[i].pid)
+            app_error("FAIL: a child's events are missing or out of order");
+        for (parse = 0; j < (int)hdr[1] && ev[j].pid == 0 && ev[j].t < ev[i].t; j++)
+            if (ev[j].type == TR_PARSE)
+                parse = ev[j].t;
+        if (parse)
+            stage[0][n[0]++] = (ev[i].t - parse) * nspertick / 1e3;
+        for (k = 1; k < 4; k++)
+            stage[k][n[k]++] = (ev[i + k].t - ev[i + k - 1].t) * nspertick / 1e3;
+    }
+    if (forks != count || execs != count || reaps != count)
+        app_error("FAIL: the trace doesn't have an event of each kind per command");
+    for (k = 0; k < 4; k++)
+    {
+        snprintf(what, sizeof(what), "  %-13s", names[k]);
+        report(what, stage[k], n[k]);
+        free(stage[k]);
+    }
+    free(ev);
+    free(samples);
+}
+
+/*
+ * run_traced - Time <count> foreground commands, with the trace on or
+ *     off; with it on, leave a binary dump in /tmp. Returns samples.
+ */
+double *run_traced(int on, double *samples)
+{
+    struct shell_t sh;
+    char line[128];
+    double t0;
+    int i;
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    if (on)
+    {
+        send_line(&sh, "trace on\n");
+        wait_prompt(&sh, NULL, NULL);
+    }
+    for (i = 0; i < count; i++)
+    {
+        t0 = now_us();
+        send_line(&sh, "/bin/sleep 0\n");
+        wait_prompt(&sh, NULL, NULL);
+        samples[i] = now_us() - t0;
+    }
+    if (on)
+    {
+        snprintf(line, sizeof(line), "trace dump -b /tmp/tshbench.%d.trace\n",
+                 (int)getpid());
+        send_line(&sh, line);
+        wait_prompt(&sh, NULL, NULL);
+    }
+    stop_shell(&sh);
+    return samples;
+}
+
+/*
+ * bench_capture - Run CAPTUREJOBS jobs that print <count> MB each with
+ *     the shell's capture on, wait for all of them, and check that none
+ *     of it reached us and that the shell grew by at most a ring per job
+ *     and CAPTURESLACK. Then check jobs -o on a job that printed a MB.
+ */
+void bench_capture(void)
+{
+    struct shell_t sh;
+    char line[MAXBUF], last[MAXBUF];
+    double t0, t, cpu0, cpu1;
+    long ctx0, ctx1, rss0, rss1, dropped = 0;
+    int i, lines;
+
+    if (!count)
+        count = 64;
+    start_shell(&sh, "-o");
+    wait_prompt(&sh, NULL, NULL);
+    proc_usage(sh.pid, &cpu0, &ctx0);
+    rss0 = proc_rss(sh.pid);
+    snprintf(line, sizeof(line), "./myload -o %ld &\n", (long)count << 20);
+    t0 = now_us();
+    for (i = 0; i < CAPTUREJOBS; i++)
+    {
+        send_line(&sh, line);
+        if (wait_prompt(&sh, NULL, NULL) != 1)
+            app_error("FAIL: a job's output reached the shell's");
+    }
+    do
+    { /* the job list is empty once all of it has been read */
+        send_line(&sh, "jobs\n");
+    } while (wait_prompt(&sh, NULL, NULL) > 0 && usleep(1000) == 0);
+    t = (now_us() - t0) / 1e6;
+    proc_usage(sh.pid, &cpu1, &ctx1);
+    rss1 = proc_rss(sh.pid);
+    printf("%d jobs x %d MB: %.2fs (%.0f MB/s), tsh cpu %.1fms, "
+           "%ld context switches, grew %ldKB\n",
+           CAPTUREJOBS, count, t, CAPTUREJOBS * count / t, cpu1 - cpu0,
+           ctx1 - ctx0, rss1 - rss0);
+    if (rss1 - rss0 > CAPTUREJOBS * (CAPTURECAP >> 10) + CAPTURESLACK)
+        app_error("FAIL: the shell grew by more than a ring per job");
+
+    /* 1 MB, of which the ring keeps the last 1024 lines */
+    start_job(&sh, "./myload -o 1048576 -s 10000 &\n", &i);
+    snprintf(line, sizeof(line), "jobs -o %%%d\n", i);
+    t0 = now_us();
+    do
+    {
+        if (now_us() - t0 > 10e6)
+            app_error("FAIL: jobs -o never showed the last 64 KB");
+        send_line(&sh, line);
+    } while ((lines = wait_prompt(&sh, NULL, NULL)) != CAPTURECAP / 64 + 1 &&
+             usleep(1000) == 0);
+    send_line(&sh, line);
+    if (wait_prompt(&sh, "bytes dropped", last) != 1 ||
+        sscanf(last, "[%ld bytes dropped]", &dropped) != 1 ||
+        dropped != (1 << 20) - CAPTURECAP)
+        app_error("FAIL: jobs -o didn't say how much was dropped");
+    printf("jobs -o: %d lines, %ld bytes dropped\n", lines, dropped);
+    snprintf(line, sizeof(line), "kill %%%d\n", i);
+    send_line(&sh, line);
+    wait_prompt(&sh, NULL, NULL);
+    stop_shell(&sh);
+    printf("PASS\n");
+}
+
+/*
+ * bench_signals - Time and stress the shell's signal forwarding.
+ *
+ * The shell is the session leader of a pty and, as tsh doesn't hand
+ * the terminal to its jobs, the terminal's foreground process group:
+ * a ctrl-c typed on the master goes to the shell, which passes it on
+ * to the foreground job. The job is our catch mode, which notes when
+ * each signal arrives, on the shell's trace clock too, so the shell's
+ * trace dump splits the time at the moment the shell read the signal.
+ */
+void bench_signals(void)
+{
+    struct shell_t sh;
+    struct trevent_t *ev;
+    char self[4096], path[64], line[MAXBUF], magic[8], storm[256];
+    double *e2e[2], *fwd[2], *stop_us, *cont_us, t0, t_storm, nspertick;
+    uint64_t hdr[2], storm0, storm1;
+    long before, sent, got[2], nread[2] = {0, 0};
+    int i, k, n, cycles, lost = 0, nfwd[2] = {0, 0};
+    ssize_t len;
+    FILE *fp;
+
+    if ((len = readlink("/proc/self/exe", self, sizeof(self) - 1)) < 0)
+        unix_error("readlink error");
+    self[len] = '\0';
+    if (!count)
+        count = 1000;
+    if (count > SIGSAMPLES)
+        count = SIGSAMPLES;
+    cycles = count / 10 ? count / 10 : 1;
+    for (k = 0; k < 2; k++)
+        if ((e2e[k] = malloc(count * sizeof(double))) == NULL ||
+            (fwd[k] = malloc(count * sizeof(double))) == NULL)
+            unix_error("malloc error");
+    if ((stop_us = malloc(cycles * sizeof(double))) == NULL ||
+        (cont_us = malloc(cycles * sizeof(double))) == NULL)
+        unix_error("malloc error");
+    snprintf(path, sizeof(path), "/tmp/tshbench.%d.sig", (int)getpid());
+    map_signals(path, 1);
+
+    start_pty_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    send_line(&sh, "trace on\n");
+    wait_prompt(&sh, NULL, NULL);
+    snprintf(line, sizeof(line), "%s catch %s\n", self, path);
+    send_line(&sh, line);
+    for (t0 = now_us(); !sigmap->ready; usleep(1000))
+        if (now_us() - t0 > 5 * SIGWAIT)
+            app_error("FAIL: the catch job didn't start");
+
+    /* one keystroke at a time: ctrl-c, then ctrl-z (caught, no stop) */
+    for (k = 0; k < 2; k++)
+        for (i = 0; i < count; i++)
+            if (!type_key(&sh, k ? 0x1a : 0x03, k, &e2e[k][i]))
+                lost++;
+
+    /* ctrl-z that stops the job, and fg */
+    sigmap->stopmode = 1;
+    type_key(&sh, 0x03, 0, &t0); /* wakes it up to apply that */
+    while (sigmap->mode != 1)
+        usleep(100);
+    for (i = 0; i < cycles; i++)
+    {
+        t0 = now_us();
+        if (write(sh.in, "\x1a", 1) != 1)
+            unix_error("write error");
+        if (wait_prompt(&sh, "stopped", NULL) != 1)
+            app_error("FAIL: a ctrl-z didn't stop the job");
+        stop_us[i] = now_us() - t0;
+        before = sigmap->n[2];
+        t0 = now_us();
+        send_line(&sh, "fg %1\n");
+        while (sigmap->n[2] == before)
+            if (now_us() - t0 > SIGWAIT)
+                app_error("FAIL: fg didn't continue the job");
+        cont_us[i] = sigmap->us[2] - t0;
+    }
+    sigmap->stopmode = 0;
+    type_key(&sh, 0x03, 0, &t0);
+    while (sigmap->mode != 0)
+        usleep(100);
+
+    /* the storm: ctrl-c and ctrl-z as fast as the pty takes them */
+    for (i = 0; i < (int)sizeof(storm); i++)
+        storm[i] = i & 1 ? 0x1a : 0x03;
+    got[0] = sigmap->n[0];
+    got[1] = sigmap->n[1];
+    storm0 = trace_clock();
+    t_storm = now_us();
+    for (sent = 0; sent < STORMSIGS; sent += sizeof(storm))
+        if (write(sh.in, storm, sizeof(storm)) != (ssize_t)sizeof(storm))
+            unix_error("write error");
+    t_storm = now_us() - t_storm;
+    do
+    {
+        before = sigmap->n[0] + sigmap->n[1];
+        usleep(100000);
+    } while (sigmap->n[0] + sigmap->n[1] != before);
+    storm1 = trace_clock();
+    got[0] = sigmap->n[0] - got[0];
+    got[1] = sigmap->n[1] - got[1];
+    if (!type_key(&sh, 0x03, 0, &t0) || !type_key(&sh, 0x1a, 1, &t0))
+        app_error("FAIL: signals don't get through after the storm");
+
+    /* the job leaves at the next ctrl-c; then nothing is to be left */
+    sigmap->quit = 1;
+    if (write(sh.in, "\x03", 1) != 1)
+        unix_error("write error");
+    wait_prompt(&sh, NULL, NULL);
+    send_line(&sh, "jobs\n");
+    if (wait_prompt(&sh, "] (", NULL) != 0)
+        app_error("FAIL: the job list isn't empty");
+    if (count_zombies(sh.pid))
+        app_error("FAIL: the shell left a zombie");
+    snprintf(line, sizeof(line), "trace dump -b %s.trace\n", path);
+    send_line(&sh, line);
+    wait_prompt(&sh, NULL, NULL);
+    send_line(&sh, "quit\n");
+    while (read(sh.out, line, sizeof(line)) > 0)
+        ;
+    close(sh.out);
+    waitpid(sh.pid, NULL, 0);
+
+    /* the shell read the i-th SIGINT (SIGTSTP) it got when the job got
+     * the i-th, for the first count of each */
+    snprintf(line, sizeof(line), "%s.trace", path);
+    if ((fp = fopen(line, "r")) == NULL)
+        unix_error(line);
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, "TSHTRACE", 8) ||
+        fread(&nspertick, sizeof(nspertick), 1, fp) != 1 ||
+        fread(hdr, sizeof(hdr), 1, fp) != 1)
+        app_error("FAIL: bad trace dump");
+    if ((ev = malloc(hdr[1] * sizeof(*ev) + 1)) == NULL)
+        unix_error("malloc error");
+    if (fread(ev, sizeof(*ev), hdr[1], fp) != hdr[1])
+        app_error("FAIL: short trace dump");
+    fclose(fp);
+    unlink(line);
+    for (i = 0; i < (int)hdr[1] && ev[i].pid == 0; i++)
+    {
+        if (ev[i].type != TR_SIGRECV || (ev[i].arg != SIGINT && ev[i].arg != SIGTSTP))
+            continue;
+        k = ev[i].arg == SIGTSTP;
+        if (ev[i].t >= storm0 && ev[i].t < storm1)
+            nread[k]++;
+        if ((n = nfwd[k]) < count)
+            fwd[k][nfwd[k]++] = (double)(int64_t)(sigmap->at[k][n] - ev[i].t) *
+                                nspertick / 1e3;
+    }
+    free(ev);
+    unlink(path);
+
+    report("ctrl-c, key to job  ", e2e[0], count);
+    report("ctrl-c, shell to job", fwd[0], nfwd[0]);
+    report("ctrl-z, key to job  ", e2e[1], count);
+    report("ctrl-z, shell to job", fwd[1], nfwd[1]);
+    report("ctrl-z to stopped   ", stop_us, cycles);
+    report("fg to SIGCONT       ", cont_us, cycles);
+    printf("storm: %d keys in %.1fms; the shell read %ld SIGINT and %ld SIGTSTP, "
+           "the job got %ld and %ld (pending ones merge)\n", STORMSIGS,
+           t_storm / 1e3, nread[0], nread[1], got[0], got[1]);
+    printf("%d of %d single keystrokes lost\n", lost, 2 * count);
+    if (lost)
+        app_error("FAIL: a signal didn't reach the job");
+    printf("PASS\n");
+    for (k = 0; k < 2; k++)
+    {
+        free(e2e[k]);
+        free(fwd[k]);
+    }
+    free(stop_us);
+    free(cont_us);
+}
+
+/*
+ * type_key - Type key on the shell's terminal and wait for the k-th
+ *     signal (0 SIGINT, 1 SIGTSTP) to reach the catch job. Sets *us to
+ *     the time from the keystroke to its arrival. Returns 0 if it didn't
+ *     arrive within SIGWAIT.
+ */
+int type_key(struct shell_t *sh, char key, int k, double *us)
+{
+    long before = sigmap->n[k];
+    double t0 = now_us();
+
+    if (write(sh->in, &key, 1) != 1)
+        unix_error("write error");
+    while (sigmap->n[k] == before)
+        if (now_us() - t0 > SIGWAIT)
+            return 0;
+    *us = sigmap->us[k] - t0;
+    return 1;
+}
+
+/*
+ * start_pty_shell - Start the shell in a session of its own with a new
+ *     pty, without echo, as its controlling terminal and stdio; we read
+ *     and write the master.
+ */
+void start_pty_shell(struct shell_t *sh, char *args)
+{
+    struct termios t;
+    int master, slave;
+
+    if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 ||
+        unlockpt(master) < 0)
+        unix_error("posix_openpt error");
+    if ((sh->pid = fork()) < 0)
+        unix_error("fork error");
+    if (sh->pid == 0)
+    {
+        char *argv[3] = {shell, args, NULL};
+        setsid();
+        if ((slave = open(ptsname(master), O_RDWR)) < 0)
+            unix_error("open pty error");
+        ioctl(slave, TIOCSCTTY, 0);
+        tcgetattr(slave, &t);
+        t.c_lflag &= ~ECHO;
+        tcsetattr(slave, TCSANOW, &t);
+        dup2(slave, 0);
+        dup2(slave, 1);
+        dup2(slave, 2);
+        close(slave);
+        close(master);
+        execv(shell, argv);
+        unix_error("execv error");
+    }
+    sh->in = sh->out = master;
+}
+
+/* map_signals - Map the signals mode's file (making it, if create) */
+void map_signals(const char *path, int create)
+{
+    int fd;
+
+    if ((fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600)) < 0)
+        unix_error((char *)path);
+    if (create && ftruncate(fd, sizeof(struct sigmap_t)) < 0)
+        unix_error("ftruncate error");
+    if ((sigmap = mmap(NULL, sizeof(struct sigmap_t), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0)) == MAP_FAILED)
+        unix_error("mmap error");
+    close(fd);
+}
+
+/*
+ * catch_signals - The signals mode's job: count the signals it gets in
+ *     the file at path until it is told to quit. It sleeps in
+ *     sigsuspend(), and after each signal applies stopmode: the default
+ *     action for SIGTSTP, or the handler.
+ */
+void catch_signals(const char *path)
+{
+    struct sigaction sa;
+    sigset_t mask, none;
+
+    map_signals(path, 0);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = catch_handler;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTSTP, &sa, NULL);
+    sigaction(SIGCONT, &sa, NULL);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    sigaddset(&mask, SIGCONT);
+    sigprocmask(SIG_BLOCK, &mask, &none);
+    sigmap->ready = 1;
+    while (1)
+    {
+        if (sigmap->mode != sigmap->stopmode)
+        {
+            sa.sa_handler = sigmap->stopmode ? SIG_DFL : catch_handler;
+            sigaction(SIGTSTP, &sa, NULL);
+            sigmap->mode = sigmap->stopmode;
+        }
+        sigsuspend(&none);
+    }
+}
+
+/* catch_handler - Note the arrival of a signal in the catch job */
+void catch_handler(int sig)
+{
+    int k = sig == SIGINT ? 0 : sig == SIGTSTP ? 1 : 2;
+    long i = sigmap->n[k];
+
+    if (k < 2 && i < SIGSAMPLES)
+        sigmap->at[k][i] = trace_clock();
+    sigmap->us[k] = now_us();
+    sigmap->n[k] = i + 1;
+    if (sig == SIGINT && sigmap->quit)
+        _exit(0);
+}
+
+/* trace_clock - The clock of tsh's trace: the TSC on x86, else ns */
+uint64_t trace_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * bench_pidwrap - Run pidwrap_ns() as init of a new PID namespace,
+ *     where we may set the next PID and nothing else takes PIDs.
+ */
+void bench_pidwrap(void)
+{
+    pid_t pid;
+    int status;
+
+    if (!count)
+        count = 200;
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+        unix_error("fork error");
+    if (pid == 0)
+    {
+        if (unshare(CLONE_NEWPID) < 0)
+        {
+            printf("pidwrap: no PID namespace (%s), SKIP\n", strerror(errno));
+            exit(0);
+        }
+        if ((pid = fork()) < 0)
+            unix_error("fork error");
+        if (pid == 0)
+            pidwrap_ns(); /* PID 1 */
+        waitpid(pid, &status, 0);
+        _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+    }
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+        exit(1);
+}
+
+/*
+ * pidwrap_ns - Each round, a background job is killed and reaped and a
+ *     new job (alternately a single command and the second stage of a
+ *     pipeline) is given its PID, which jobs, bg and kill must see as
+ *     the new job. Then a job that exits is reaped and its PID given to
+ *     a process of ours: bg and kill on the old JID must find no job and
+ *     leave that process alone.
+ */
+void pidwrap_ns(void)
+{
+    struct shell_t sh;
+    char line[MAXBUF], last[MAXBUF];
+    pid_t old, new, other;
+    int i, jid, newjid, status, reused = 0, spared = 0;
+
+    start_shell(&sh, shellarg);
+    wait_prompt(&sh, NULL, NULL);
+    for (i = 0; i < count; i++)
+    {
+        /* a new job gets the PID of a job that was killed */
+        old = start_job(&sh, "./myspin 100 &\n", &jid);
+        sprintf(line, "kill %%%d\n", jid);
+        send_line(&sh, line);
+        wait_prompt(&sh, NULL, NULL);
+        wait_gone(old);
+        set_last_pid(old - (i & 1 ? 2 : 1));
+        new = start_job(&sh, i & 1 ? "./myspin 100 | ./myspin 100 &\n"
+                                   : "./myspin 100 &\n", &newjid);
+        if (new != old - (i & 1))
+            app_error("FAIL: could not reuse a PID");
+        sprintf(line, "[%d] (%d) Running", newjid, new);
+        send_line(&sh, "jobs\n");
+        if (wait_prompt(&sh, "Running", last) != 1 || strncmp(last, line, strlen(line)))
+            app_error("FAIL: jobs lost track of a reused PID");
+        sprintf(line, "bg %%%d\n", newjid);
+        send_line(&sh, line);
+        if (wait_prompt(&sh, "myspin", NULL) != 1)
+            app_error("FAIL: bg lost track of a reused PID");
+        sprintf(line, "kill %%%d\n", newjid);
+        send_line(&sh, line);
+        wait_prompt(&sh, NULL, NULL);
+        wait_gone(new);
+        reused++;
+
+        /* an unrelated process gets the PID of a job that exited */
+        old = start_job(&sh, "/bin/sleep 0 &\n", &jid);
+        wait_gone(old);
+        set_last_pid(old - 1);
+        if ((other = fork()) < 0)
+            unix_error("fork error");
+        if (other == 0)
+        {
+            pause();
+            _exit(0);
+        }
+        if (other != old)
+            app_error("FAIL: could not reuse a PID");
+        sprintf(line, "bg %%%d\n", jid);
+        send_line(&sh, line);
+        if (wait_prompt(&sh, "No such job", NULL) != 1)
+            app_error("FAIL: the shell still knows a reaped job");
+        sprintf(line, "kill %%%d\n", jid);
+        send_line(&sh, line);
+        if (wait_prompt(&sh, "No such job", NULL) != 1)
+            app_error("FAIL: the shell still knows a reaped job");
+        if (waitpid(other, &status, WNOHANG | WUNTRACED | WCONTINUED) != 0)
+            app_error("FAIL: the shell signalled a process that reused a PID");
+        kill(other, SIGKILL);
+        waitpid(other, NULL, 0);
+        spared++;
+    }
+    stop_shell(&sh);
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+        ; /* orphans come to us */
+    printf("PIDs reused: %d by new jobs, %d by other processes\n", reused, spared);
+    printf("PASS\n");
+    fflush(stdout);
+    _exit(0); /* LeakSanitizer can't run as PID 1 */
+}
+
+/* start_job - Start a background job; returns its PID and sets *jid */
+pid_t start_job(struct shell_t *sh, const char *line, int *jid)
+{
+    char last[MAXBUF];
+    pid_t pid;
+
+    send_line(sh, line);
+    if (wait_prompt(sh, "] (", last) != 1 || sscanf(last, "[%d] (%d)", jid, &pid) != 2)
+        app_error("background job was not started");
+    return pid;
+}
+
+/* wait_gone - Wait until pid has been reaped (by anyone) */
+void wait_gone(pid_t pid)
+{
+    struct timespec ms = {0, 1000000};
+    int tries;
+
+    for (tries = 0; kill(pid, 0) == 0 || errno != ESRCH; tries++)
+    {
+        if (tries == 5000)
+            app_error("FAIL: a child was never reaped");
+        nanosleep(&ms, NULL);
+    }
+}
+
+/* set_last_pid - Make pid + 1 the next PID of our namespace */
+void set_last_pid(pid_t pid)
+{
+    FILE *fp;
+
+    if ((fp = fopen("/proc/sys/kernel/ns_last_pid", "w")) == NULL)
+        unix_error("ns_last_pid error");
+    fprintf(fp, "%d", pid);
+    if (fclose(fp) != 0)
+        unix_error("ns_last_pid error");
+}
+
+/*
+ * run_script - Seconds the shell takes to run script, given as its
+ *     argument or (if piped) written to its stdin by another process.
+ *     Its output goes to /dev/null.
+ */
+double run_script(const char *script, int piped)
+{
+    char buf[MAXBUF];
+    int fds[2], fd, null;
+    pid_t pid, feeder = 0;
+    ssize_t n;
+    double t0;
+
+    if (piped && pipe(fds) < 0)
+        unix_error("pipe error");
+    t0 = now_us();
+    if (piped && (feeder = fork()) == 0)
+    {
+        close(fds[0]);
+        if ((fd = open(script, O_RDONLY)) < 0)
+            unix_error("open error");
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+            if (write(fds[1], buf, n) != n)
+                _exit(1);
+        _exit(0);
+    }
+    if ((pid = fork()) == 0)
+    {
+        char *argv[4] = {shell, piped ? "-p" : (char *)script, NULL, NULL};
+        if (shellarg)
+        {
+            argv[2] = argv[1];
+            argv[1] = shellarg;
+        }
+        if (piped)
+        {
+            dup2(fds[0], 0);
+            close(fds[0]);
+            close(fds[1]);
+        }
+        if ((null = open("/dev/null", O_WRONLY)) < 0)
+            unix_error("open error");
+        dup2(null, 1);
+        execv(shell, argv);
+        unix_error("execv error");
+    }
+    if (piped)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        waitpid(feeder, NULL, 0);
+    }
+    waitpid(pid, NULL, 0);
+    return (now_us() - t0) / 1e6;
+}
+
+/* time_line - Seconds from sending line to the shell to its next prompt */
+double time_line(struct shell_t *sh, const char *line)
+{
+    double t0 = now_us();
+
+    send_line(sh, line);
+    wait_prompt(sh, NULL, NULL);
+    return (now_us() - t0) / 1e6;
+}
+
+/*****************
+ * Shell plumbing
+ *****************/
+
+/*
+ * start_shell - Fork the shell under test with pipes on stdin and
+ *     stdout. args is an optional extra argument (e.g. "-p").
+ */
+void start_shell(struct shell_t *sh, char *args)
+{
+    int to[2], from[2];
+
+    if (pipe(to) < 0 || pipe(from) < 0)
+        unix_error("pipe error");
+    if ((sh->pid = fork()) < 0)
+        unix_error("fork error");
+    if (sh->pid == 0)
+    {
+        char *argv[3] = {shell, args, NULL};
+        dup2(to[0], 0);
+        dup2(from[1], 1);
+        close(to[0]);
+        close(to[1]);
+        close(from[0]);
+        close(from[1]);
+        execv(shell, argv);
+        unix_error("execv error");
+    }
+    close(to[0]);
+    close(from[1]);
+    sh->in = to[1];
+    sh->out = from[0];
+}
+
+/* stop_shell - Close the shell's stdin (EOF) and reap it */
+void stop_shell(struct shell_t *sh)
+{
+    char buf[MAXBUF];
+
+    close(sh->in);
+    while (read(sh->out, buf, sizeof(buf)) > 0)
+        ;
+    close(sh->out);
+    waitpid(sh->pid, NULL, 0);
+}
+
+/* send_line - Write one command line to the shell */
+void send_line(struct shell_t *sh, const char *line)
+{
+    size_t len = strlen(line);
+
+    if (write(sh->in, line, len) != (ssize_t)len)
+        unix_error("write error");
+}
+
+/*
+ * wait_prompt - Consume shell output up to and including the next
+ *     prompt. Returns the number of output lines before it that contain
+ *     word (all lines if word is NULL); the last of those lines is
+ *     copied to last if it isn't NULL.
+ */
+int wait_prompt(struct shell_t *sh, const char *word, char *last)
+{
+    char buf[MAXBUF], *line, *nl;
+    size_t plen = strlen(prompt), have = 0;
+    ssize_t n;
+    int lines = 0;
+
+    while (1)
+    {
+        if (have == sizeof(buf) - 1)
+            have = 0; /* drop the head of an overlong line */
+        if ((n = read(sh->out, buf + have, sizeof(buf) - have - 1)) <= 0)
+            app_error("shell exited before printing a prompt");
+        have += n;
+        buf[have] = '\0';
+        for (line = buf; (nl = memchr(line, '\n', buf + have - line)); line = nl + 1)
+        {
+            *nl = '\0';
+            if (word == NULL || strstr(line, word))
+            {
+                lines++;
+                if (last)
+                    strcpy(last, line);
+            }
+        }
+        have -= line - buf;
+        memmove(buf, line, have + 1);
+        if (have == plen && !strcmp(buf, prompt))
+            return lines;
+    }
+}
+
+/* load_jobs - Start n sleeping background jobs (JIDs 1..n) */
+void load_jobs(struct shell_t *sh, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        send_line(sh, "/bin/sleep 1000 &\n");
+        if (wait_prompt(sh, "sleep", NULL) != 1)
+            app_error("background job was not started");
+    }
+}
+
+/* unload_jobs - Kill the jobs started by load_jobs */
+void unload_jobs(struct shell_t *sh, int n)
+{
+    char line[64];
+    int jid;
+
+    for (jid = 1; jid <= n; jid++)
+    {
+        sprintf(line, "kill %%%d\n", jid);
+        send_line(sh, line);
+        wait_prompt(sh, NULL, NULL);
+    }
+}
+
+/* count_zombies - Count unreaped children of a process using /proc */
+int count_zombies(pid_t parent)
+{
+    DIR *dir;
+    struct dirent *de;
+    char path[300], state;
+    int ppid, zombies = 0;
+    FILE *fp;
+
+    if ((dir = opendir("/proc")) == NULL)
+        unix_error("opendir error");
+    while ((de = readdir(dir)) != NULL)
+    {
+        if (!isdigit((unsigned char)de->d_name[0]))
+            continue;
+        snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        /* pid (comm) state ppid ... -- comm may contain spaces */
+        if (fscanf(fp, "%*d (%*[^)]) %c %d", &state, &ppid) == 2 &&
+            ppid == parent && state == 'Z')
+            zombies++;
+        fclose(fp);
+    }
+    closedir(dir);
+    return zombies;
+}
+
+/* proc_usage - CPU time (user + system) and context switches of pid so
+ *     far, from /proc */
+void proc_usage(pid_t pid, double *cpu_ms, long *ctxsw)
+{
+    char path[64], buf[MAXBUF], *p;
+    unsigned long utime = 0, stime = 0;
+    long n;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if ((fp = fopen(path, "r")) == NULL)
+        unix_error("fopen error");
+    /* fields 14 and 15, counted after "(comm)", which may have spaces */
+    if (fgets(buf, sizeof(buf), fp) && (p = strrchr(buf, ')')) != NULL)
+        sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime);
+    fclose(fp);
+    *cpu_ms = (utime + stime) * 1e3 / sysconf(_SC_CLK_TCK);
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    if ((fp = fopen(path, "r")) == NULL)
+        unix_error("fopen error");
+    *ctxsw = 0;
+    while (fgets(buf, sizeof(buf), fp))
+        if (sscanf(buf, "voluntary_ctxt_switches: %ld", &n) == 1 ||
+            sscanf(buf, "nonvoluntary_ctxt_switches: %ld", &n) == 1)
+            *ctxsw += n;
+    fclose(fp);
+}
+
+/* proc_rss - Resident set size of pid, in KB, from /proc */
+long proc_rss(pid_t pid)
+{
+    char path[64], buf[MAXBUF];
+    long kb = 0;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    if ((fp = fopen(path, "r")) == NULL)
+        unix_error("fopen error");
+    while (fgets(buf, sizeof(buf), fp))
+        if (sscanf(buf, "VmRSS: %ld", &kb) == 1)
+            break;
+    fclose(fp);
+    return kb;
+}
+
+/************
+ * Reporting
+ ************/
+
+/* now_us - Monotonic clock in microseconds */
+double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* report - Print percentiles of a set of samples (in microseconds) */
+void report(const char *what, double *samples, int n)
+{
+    double sum = 0;
+    int i;
+
+    qsort(samples, n, sizeof(double), cmp_double);
+    for (i = 0; i < n; i++)
+        sum += samples[i];
+    printf("%s: n=%d p50=%.1fus p99=%.1fus max=%.1fus (%.0f cmds/s)\n",
+           what, n, samples[n / 2], samples[(n * 99) / 100], samples[n - 1],
+           n / (sum / 1e6));
+}
+
+/*
+ * usage - print a help message
+ */
+void usage(void)
+{
+    printf("Usage: tshbench [-h] [-s <shell>] [-a <arg>] [-c <cmd>] [-n <count>]\n"
+           "                [-j <jobs>] <mode>\n");
+    printf("   -h          print this message\n");
+    printf("   -s <shell>  shell to benchmark (default ./tsh)\n");
+    printf("   -a <arg>    extra shell argument (e.g. -s)\n");
+    printf("   -c <cmd>    command timed by latency (default /bin/true)\n");
+    printf("   -n <count>  number of samples\n");
+    printf("   -j <jobs>   background jobs to hold during latency runs\n");
+    printf("Modes:\n");
+    printf("   latency     foreground <cmd> turnaround\n");
+    printf("   reap        reap <count> background jobs killed together\n");
+    printf("   jobs        bg/kill lookups with <count> jobs in the list\n");
+    printf("   spawn       fork vs posix_spawn launch rate by parent RSS\n");
+    printf("   pipe        <count> MB through a pipeline, tsh vs /bin/sh\n");
+    printf("   cat         cat builtin vs /bin/cat MB/s into a file and a pipe\n");
+    printf("   script      lines/s of a <count>-line script, file and pipe\n");
+    printf("   trace       cmds/s replaying trace15.txt, in-process echo vs -E\n");
+    printf("   jtop        shell CPU per jtop sample with <count> jobs\n");
+    printf("   pidwrap     <count> forced PID reuses in a PID namespace (root)\n");
+    printf("   affinity    <count> CPU-bound jobs, inherited affinity vs spread cpu\n");
+    printf("   parallel    makespan of <count> tasks queued for parallel -j N\n");
+    printf("   dag         a diamond of after jobs <count> wide vs its critical path\n");
+    printf("   zygote      launch latency of fork, posix_spawn and the zygote\n");
+    printf("   lifecycle   turnaround with the trace off and on, and its breakdown\n");
+    printf("   signals     ctrl-c/ctrl-z latency and storms on a pty\n");
+    printf("   capture     output of jobs printing <count> MB each into -o rings\n");
+    exit(1);
+}
+
+/*
+ * unix_error - unix-style error routine
+ */
+void unix_error(char *msg)
+{
+    fprintf(stdout, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * app_error - application-style error routine
+ */
+void app_error(char *msg)
+{
+    fprintf(stdout, "%s\n", msg);
+    exit(1);
+}
@@ -0,0 +1,957 @@
+/*
+ * tshdriver - Trace driver for the tiny shell, with timing
+ *
+ * usage: tshdriver [-hv] [-s <shell>] [-r <refshell>] [-a <args>]
+ *                  [-j <runs>] [-w <ms>] [-T <secs>] <trace>...
+ *
+ * Runs each trace under the shell and under the reference shell, each
+ * on a pty of its own and up to <runs> of them at a time, compares the
+ * two outputs the way checktsh.pl does and reports how long the shell
+ * took over each command. The traces are in sdriver.pl's format, with
+ * two more directives:
+ *
+ *     WAITFOR <regex>     Wait until the output since the last match
+ *                         matches <regex> (POSIX extended), for at most
+ *                         <ms> (default 5000). Where a trace would SLEEP
+ *                         for something the shell prints, this goes on
+ *                         as soon as it's there.
+ *     EXPECT_WITHIN <ms>  Fail the trace if the shell took more than
+ *                         <ms> over the command before.
+ *
+ * sdriver.pl would take WAITFOR for WAIT, so a trace that uses them is
+ * for this driver only.
+ *
+ * A command's latency runs from the moment the shell reads its line
+ * until it reads the next one or, with WAITFOR after the command, until
+ * the match. A shell on a tty gets one line per read, so we see it read
+ * a line when the line leaves the pty's input queue, which we look at
+ * every SAMPLEUS while lines are in flight: that is the resolution, and
+ * a command that takes less, or that the shell gets through while we
+ * are waiting for a CPU, has no latency.
+ * The lines between two directives are written at once, and a latency
+ * is only counted if the next line was already queued, so that time the
+ * shell spent idle isn't: the command before a SLEEP (a background job,
+ * say) has none, and neither has the last one.
+ *
+ * The ps output of traces 12 to 14 changes from run to run and isn't
+ * compared here; checktsh.pl checks those traces.
+ */
+#define _GNU_SOURCE /* for ppoll and the pty functions */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <regex.h>
+#include <dirent.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sched.h>
+
+#define MAXLINE 1024   /* longest trace line */
+#define SAMPLEUS 100   /* us between looks at the input queue, in flight */
+#define IDLEUS 10000   /* us between looks otherwise */
+#define MINRUNS 8      /* runs at a time by default, at least */
+
+/* Kinds of trace step */
+#define S_LINE 0    /* a command line for the shell */
+#define S_SIGNAL 1  /* TSTP, INT, QUIT or KILL */
+#define S_CLOSE 2   /* CLOSE: end the shell's input */
+#define S_WAIT 3    /* WAIT: wait for the shell to exit */
+#define S_SLEEP 4   /* SLEEP <n> */
+#define S_WAITFOR 5 /* WAITFOR <regex> */
+
+struct step_t
+{
+    int type;
+    char *text; /* the line or the regex */
+    int arg;    /* command index, signal or seconds */
+    regex_t re; /* WAITFOR */
+};
+
+/* A command line of a trace */
+struct cmd_t
+{
+    char *line;
+    int limit; /* EXPECT_WITHIN ms, 0 if none */
+};
+
+/* What a run of a trace left, in memory shared with its worker */
+struct result_t
+{
+    int status;    /* wait status of the shell, -1 if it didn't exit */
+    double secs;   /* wall time of the run */
+    char why[256]; /* why the run was cut short, "" if it wasn't */
+    double ms[];   /* latency of each command, -1 if not measured */
+};
+
+/* A trace run under one shell by a worker process */
+struct run_t
+{
+    char *shell;
+    pid_t worker;        /* 0 before it starts, -1 once it's done */
+    FILE *out;           /* the shell's output, written by the worker */
+    struct result_t *res;
+};
+
+struct trace_t
+{
+    char *name;
+    struct step_t *steps;
+    int nsteps;
+    struct cmd_t *cmds;
+    int ncmds;
+    struct run_t run[2]; /* under the shell and the reference */
+};
+
+/* A shell on a pty, as its worker sees it */
+struct session_t
+{
+    pid_t pid;        /* the shell, a session leader */
+    int master;       /* we write its input and read its output here */
+    int slave;        /* kept open to look at the input queue */
+    char eof;         /* the VEOF character */
+    char *out;        /* everything it printed, NUL terminated */
+    size_t len, cap;
+    size_t mark;      /* where the next WAITFOR starts looking */
+    long sent;        /* bytes written to its input */
+    long *end;        /* sent, once each command line was written */
+    double *t_sent;   /* when each line was written */
+    double *t_read;   /* when the shell read it */
+    int nsent, nread; /* command lines written and read */
+    int slept;        /* we have slept since the last write */
+    double t_eof;     /* when its input was closed, 0 if it isn't */
+    double deadline;  /* when the run is cut short */
+    int exited;       /* the shell has been reaped */
+    int status;
+    double *ms;       /* the result's latencies */
+};
+
+char *shell = "./tsh";      /* shell under test */
+char *refshell = "./tshref"; /* reference shell */
+char *shellargs = "-p";     /* arguments of both */
+int verbose = 0;
+int waitms = 5000;          /* WAITFOR timeout */
+int timeout = 25;           /* seconds a run may take, as in grade.sh */
+
+void usage(void);
+void unix_error(char *msg);
+void app_error(char *msg);
+
+void read_trace(struct trace_t *t, char *name);
+void start_run(struct trace_t *t, int which);
+void run_trace(struct trace_t *t, struct run_t *r);
+void start_session(struct session_t *s, char *prog);
+void end_session(struct session_t *s);
+void send_bytes(struct session_t *s, const char *buf, size_t n);
+int pump(struct session_t *s, double until, regex_t *re, int toexit);
+void sample(struct session_t *s);
+void settle(struct session_t *s, int k, double t, double t_next);
+void kill_session(pid_t sid);
+int finish_trace(struct trace_t *t);
+char *compare(char *ref, char *out);
+char *nextcmp(char **p, int *inps);
+void normalize(char *line);
+char *read_all(FILE *fp);
+int latencies(struct result_t *res, int n, double *p50, double *max);
+char *fmt_ms(char *buf, double ms);
+double now_us(void);
+int cmp_double(const void *a, const void *b);
+
+int main(int argc, char **argv)
+{
+    struct trace_t *traces;
+    int ntraces, c, i, status, runs, next, running, shown, failed;
+    long jobs = 0;
+    double t0;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "hvs:r:a:j:w:T:")) != EOF)
+    {
+        switch (c)
+        {
+        case 'v':
+            verbose = 1;
+            break;
+        case 's':
+            shell = optarg;
+            break;
+        case 'r':
+            refshell = optarg;
+            break;
+        case 'a':
+            shellargs = optarg;
+            break;
+        case 'j':
+            jobs = atol(optarg);
+            break;
+        case 'w':
+            waitms = atoi(optarg);
+            break;
+        case 'T':
+            timeout = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind >= argc || jobs < 0 || waitms < 1 || timeout < 1)
+        usage();
+    if (jobs == 0 && (jobs = sysconf(_SC_NPROCESSORS_ONLN) * 4) < MINRUNS)
+        jobs = MINRUNS; /* the traces mostly sleep */
+
+    ntraces = argc - optind;
+    if ((traces = calloc(ntraces, sizeof(struct trace_t))) == NULL)
+        unix_error("calloc error");
+    for (i = 0; i < ntraces; i++)
+        read_trace(&traces[i], argv[optind + i]);
+
+    /* Runs start in trace order; traces are reported in order too */
+    t0 = now_us();
+    runs = 2 * ntraces;
+    next = running = shown = failed = 0;
+    while (shown < ntraces)
+    {
+        while (running < jobs && next < runs)
+        {
+            start_run(&traces[next / 2], next % 2);
+            next++;
+            running++;
+        }
+        if ((pid = wait(&status)) < 0)
+            unix_error("wait error");
+        for (i = 0; i < runs; i++)
+        {
+            if (traces[i / 2].run[i % 2].worker == pid)
+            {
+                traces[i / 2].run[i % 2].worker = -1;
+                running--;
+            }
+        }
+        while (shown < ntraces && traces[shown].run[0].worker == -1 &&
+               traces[shown].run[1].worker == -1)
+            failed += finish_trace(&traces[shown++]);
+    }
+    printf("%d traces, %d failed, in %.1f s\n", ntraces, failed,
+           (now_us() - t0) / 1e6);
+    exit(failed > 0);
+}
+
+/*
+ * read_trace - Read a trace file into steps, keeping its command lines
+ *     (with their EXPECT_WITHIN limits) apart for the report.
+ */
+void read_trace(struct trace_t *t, char *name)
+{
+    char line[MAXLINE], msg[MAXLINE + 64], *p;
+    struct step_t *s;
+    int cap = 0, ms, err;
+    FILE *fp;
+
+    t->name = name;
+    if ((fp = fopen(name, "r")) == NULL)
+    {
+        snprintf(msg, sizeof(msg), "%s: %s", name, strerror(errno));
+        app_error(msg);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || line[strspn(line, " \t")] == '\0')
+            continue;
+        if (!strncmp(line, "EXPECT_WITHIN ", 14))
+        {
+            if (t->ncmds == 0 || (ms = atoi(line + 14)) <= 0)
+            {
+                snprintf(msg, sizeof(msg), "%s: bad %s", name, line);
+                app_error(msg);
+            }
+            t->cmds[t->ncmds - 1].limit = ms;
+            continue;
+        }
+        if (t->nsteps == cap)
+        {
+            cap = cap ? 2 * cap : 64;
+            if ((t->steps = realloc(t->steps, cap * sizeof(struct step_t))) ==
+                    NULL ||
+                (t->cmds = realloc(t->cmds, cap * sizeof(struct cmd_t))) == NULL)
+                unix_error("realloc error");
+        }
+        s = &t->steps[t->nsteps++];
+        if ((s->text = strdup(line)) == NULL)
+            unix_error("strdup error");
+        s->arg = 0;
+
+        /* WAITFOR has WAIT in it; then sdriver.pl's tests, in its order */
+        if (!strncmp(line, "WAITFOR ", 8))
+        {
+            s->type = S_WAITFOR;
+            if ((err = regcomp(&s->re, line + 8, REG_EXTENDED | REG_NEWLINE)) != 0)
+            {
+                p = msg + snprintf(msg, sizeof(msg), "%s: %s: ", name, line);
+                regerror(err, &s->re, p, msg + sizeof(msg) - p);
+                app_error(msg);
+            }
+        }
+        else if (strstr(line, "TSTP"))
+            s->type = S_SIGNAL, s->arg = SIGTSTP;
+        else if (strstr(line, "INT"))
+            s->type = S_SIGNAL, s->arg = SIGINT;
+        else if (strstr(line, "QUIT"))
+            s->type = S_SIGNAL, s->arg = SIGQUIT;
+        else if (strstr(line, "KILL"))
+            s->type = S_SIGNAL, s->arg = SIGKILL;
+        else if (strstr(line, "CLOSE"))
+            s->type = S_CLOSE;
+        else if (strstr(line, "WAIT"))
+            s->type = S_WAIT;
+        else if ((p = strstr(line, "SLEEP ")) != NULL && isdigit((unsigned char)p[6]))
+            s->type = S_SLEEP, s->arg = atoi(p + 6);
+        else
+        {
+            s->type = S_LINE;
+            s->arg = t->ncmds;
+            t->cmds[t->ncmds].line = s->text;
+            t->cmds[t->ncmds++].limit = 0;
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * start_run - Fork a worker to run trace t under the shell (which 0) or
+ *     the reference (which 1). Its output goes to a temporary file and
+ *     the rest of what it finds to a shared result.
+ */
+void start_run(struct trace_t *t, int which)
+{
+    struct run_t *r = &t->run[which];
+    size_t size = sizeof(struct result_t) + (t->ncmds + 1) * sizeof(double);
+
+    r->shell = which ? refshell : shell;
+    if ((r->out = tmpfile()) == NULL)
+        unix_error("tmpfile error");
+    fcntl(fileno(r->out), F_SETFD, FD_CLOEXEC);
+    if ((r->res = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        unix_error("mmap error");
+    fflush(stdout);
+    if ((r->worker = fork()) < 0)
+        unix_error("fork error");
+    if (r->worker == 0)
+    {
+        run_trace(t, r);
+        exit(0);
+    }
+}
+
+/*
+ * run_trace - In a worker, start r's shell on a pty and play it trace
+ *     t, timing each command, then save what it printed.
+ */
+void run_trace(struct trace_t *t, struct run_t *r)
+{
+    struct session_t s;
+    struct step_t *st;
+    struct sched_param sp;
+    size_t n, bufsize = MAXLINE;
+    char *buf;
+    double t0 = now_us(), now;
+    int i, k, first;
+
+    memset(&s, 0, sizeof(s));
+    if ((s.end = malloc((t->ncmds + 1) * sizeof(long))) == NULL ||
+        (s.t_sent = malloc((t->ncmds + 1) * sizeof(double))) == NULL ||
+        (s.t_read = malloc((t->ncmds + 1) * sizeof(double))) == NULL)
+        unix_error("malloc error");
+    if ((buf = malloc(bufsize)) == NULL)
+        unix_error("malloc error");
+    /*
+     * So that we sample when we mean to: a fine timer, and (if we may)
+     * a real-time priority, which our shell doesn't inherit, or a CPU
+     * shared with it would take us off it for milliseconds at a time.
+     */
+    prctl(PR_SET_TIMERSLACK, 1);
+    sp.sched_priority = 1;
+    sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &sp);
+    s.ms = r->res->ms;
+    for (i = 0; i < t->ncmds; i++)
+        s.ms[i] = -1;
+    s.deadline = t0 + timeout * 1e6;
+    r->res->status = -1;
+    start_session(&s, r->shell);
+
+    for (i = 0; i < t->nsteps && !r->res->why[0]; i++)
+    {
+        st = &t->steps[i];
+        sample(&s);
+        switch (st->type)
+        {
+        case S_LINE:
+            /* All the lines up to the next directive go in one write */
+            for (n = 0, first = s.nsent; i < t->nsteps && st->type == S_LINE; st++, i++)
+            {
+                if (n + strlen(st->text) + 2 > bufsize &&
+                    (buf = realloc(buf, bufsize = 2 * bufsize + strlen(st->text))) == NULL)
+                    unix_error("realloc error");
+                n += sprintf(buf + n, "%s\n", st->text);
+                s.end[s.nsent++] = s.sent + n;
+            }
+            i--;
+            if (s.exited || s.t_eof)
+            {
+                s.nsent = first;
+                break;
+            }
+            send_bytes(&s, buf, n);
+            for (k = first, now = now_us(); k < s.nsent; k++)
+                s.t_sent[k] = now;
+            break;
+        case S_SIGNAL:
+            kill(s.pid, st->arg);
+            break;
+        case S_CLOSE:
+            if (!s.t_eof)
+            {
+                send_bytes(&s, &s.eof, 1);
+                s.t_eof = now_us();
+            }
+            break;
+        case S_WAIT:
+            if (pump(&s, s.deadline, NULL, 1) < 0)
+                snprintf(r->res->why, sizeof(r->res->why), "timed out after %d s",
+                         timeout);
+            break;
+        case S_SLEEP:
+            if (pump(&s, now_us() + st->arg * 1e6, NULL, 0) < 0)
+                snprintf(r->res->why, sizeof(r->res->why), "timed out after %d s",
+                         timeout);
+            break;
+        case S_WAITFOR:
+            if (pump(&s, now_us() + waitms * 1e3, &st->re, 0) > 0)
+            {
+                if ((k = s.nsent - 1) >= 0 && s.ms[k] < 0)
+                    s.ms[k] = k < s.nread ? (now_us() - s.t_read[k]) / 1e3 : -2;
+            }
+            else if (s.exited)
+                snprintf(r->res->why, sizeof(r->res->why), "exited before %s",
+                         st->text);
+            else
+                snprintf(r->res->why, sizeof(r->res->why),
+                         "no match for %s within %d ms", st->text, waitms);
+            break;
+        }
+    }
+
+    /* End its input and let it exit, as sdriver.pl does */
+    if (!r->res->why[0])
+    {
+        if (!s.t_eof && !s.exited)
+        {
+            send_bytes(&s, &s.eof, 1);
+            s.t_eof = now_us();
+        }
+        if (pump(&s, s.deadline, NULL, 1) < 0)
+            snprintf(r->res->why, sizeof(r->res->why), "timed out after %d s",
+                     timeout);
+    }
+    sp.sched_priority = 0;
+    sched_setscheduler(0, SCHED_OTHER, &sp);
+    end_session(&s);
+    r->res->status = s.exited ? s.status : -1;
+    r->res->secs = (now_us() - t0) / 1e6;
+    fwrite(s.out, 1, s.len, r->out);
+    fflush(r->out);
+    free(s.out);
+    free(s.end);
+    free(s.t_sent);
+    free(s.t_read);
+    free(buf);
+}
+
+/*
+ * start_session - Start prog in a session of its own with a new pty as
+ *     its controlling terminal and stdio: no echo and no output
+ *     processing, but lines, so that the shell reads one at a time.
+ */
+void start_session(struct session_t *s, char *prog)
+{
+    char *argv[MAXLINE / 2 + 2], args[MAXLINE], *p;
+    struct termios tio;
+    int argc = 0, fd;
+
+    argv[argc++] = prog;
+    snprintf(args, sizeof(args), "%s", shellargs);
+    for (p = strtok(args, " "); p != NULL && argc <= MAXLINE / 2; p = strtok(NULL, " "))
+        argv[argc++] = p;
+    argv[argc] = NULL;
+
+    if ((s->master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0 ||
+        grantpt(s->master) < 0 || unlockpt(s->master) < 0)
+        unix_error("posix_openpt error");
+    if ((s->slave = open(ptsname(s->master), O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0)
+        unix_error("open pty error");
+    tcgetattr(s->slave, &tio);
+    tio.c_lflag &= ~(ECHO | ECHONL);
+    tio.c_oflag &= ~OPOST;
+    tcsetattr(s->slave, TCSANOW, &tio);
+    s->eof = tio.c_cc[VEOF];
+    fcntl(s->master, F_SETFL, O_NONBLOCK);
+
+    if ((s->pid = fork()) < 0)
+        unix_error("fork error");
+    if (s->pid == 0)
+    {
+        setsid();
+        if ((fd = open(ptsname(s->master), O_RDWR)) < 0)
+            unix_error("open pty error");
+        ioctl(fd, TIOCSCTTY, 0);
+        dup2(fd, 0);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        close(fd);
+        execv(prog, argv);
+        fprintf(stderr, "%s: %s\n", prog, strerror(errno));
+        _exit(127);
+    }
+    s->cap = MAXLINE;
+    if ((s->out = malloc(s->cap + 1)) == NULL)
+        unix_error("malloc error");
+    s->out[0] = '\0';
+}
+
+/*
+ * end_session - Kill the shell if it is still there and whatever it
+ *     left running, and take the last of its output.
+ */
+void end_session(struct session_t *s)
+{
+    if (!s->exited)
+    {
+        kill(s->pid, SIGKILL);
+        if (waitpid(s->pid, &s->status, 0) == s->pid)
+            s->exited = 1;
+        s->status = -1;
+    }
+    pump(s, 0, NULL, 0);
+    kill_session(s->pid);
+    close(s->master);
+    close(s->slave);
+}
+
+/* send_bytes - Write to the shell's input, reading its output if the
+ *     input queue is full */
+void send_bytes(struct session_t *s, const char *buf, size_t n)
+{
+    ssize_t w;
+
+    while (n > 0)
+    {
+        if ((w = write(s->master, buf, n)) < 0)
+        {
+            if (errno != EAGAIN && errno != EINTR)
+                unix_error("write error");
+            if (pump(s, now_us() + SAMPLEUS, NULL, 0) < 0 || s->exited)
+                return;
+            continue;
+        }
+        buf += w;
+        n -= w;
+        s->sent += w;
+        s->slept = 0;
+    }
+}
+
+/*
+ * pump - Read the shell's output and follow its input until time until,
+ *     or until re matches the output past the mark (moving the mark past
+ *     the match), or if toexit until the shell exits. Returns 1 when the
+ *     match or the exit came, 0 at until (or at the exit, waiting for a
+ *     match) and -1 past the run's deadline.
+ */
+int pump(struct session_t *s, double until, regex_t *re, int toexit)
+{
+    struct pollfd pfd = {s->master, POLLIN, 0};
+    struct timespec ts;
+    regmatch_t m;
+    double now, wait;
+    ssize_t n;
+
+    for (;;)
+    {
+        /* Everything it printed so far */
+        for (;;)
+        {
+            if (s->len == s->cap)
+            {
+                s->cap *= 2;
+                if ((s->out = realloc(s->out, s->cap + 1)) == NULL)
+                    unix_error("realloc error");
+            }
+            if ((n = read(s->master, s->out + s->len, s->cap - s->len)) <= 0)
+                break;
+            s->len += n;
+            s->out[s->len] = '\0';
+        }
+        if (!s->exited && waitpid(s->pid, &s->status, WNOHANG) == s->pid)
+            s->exited = 1;
+        sample(s);
+
+        if (re && regexec(re, s->out + s->mark, 1, &m,
+                          s->mark && s->out[s->mark - 1] != '\n' ? REG_NOTBOL : 0) == 0)
+        {
+            s->mark += m.rm_eo;
+            return 1;
+        }
+        if (toexit && s->exited)
+            return 1;
+        if (re && s->exited)
+            return 0; /* it won't print anything more */
+        now = now_us();
+        if (now >= s->deadline)
+            return -1;
+        if (now >= until)
+            return 0;
+
+        /* Look again soon if the shell has lines or an exit to report */
+        wait = s->nread < s->nsent || (s->t_eof && !s->exited) ? SAMPLEUS : IDLEUS;
+        if (wait > until - now)
+            wait = until - now;
+        ts.tv_sec = (time_t)(wait / 1e6);
+        ts.tv_nsec = (long)(wait - ts.tv_sec * 1e6) * 1000;
+        ppoll(&pfd, 1, &ts, NULL);
+        s->slept = 1;
+    }
+}
+
+/*
+ * sample - Look at the shell's input queue and note the lines it has
+ *     read since, which settles the latency of the line before each.
+ *     What we write only gets to the queue once a kernel worker has run,
+ *     so we don't look until we have slept since.
+ */
+void sample(struct session_t *s)
+{
+    double now = now_us();
+    int queued;
+
+    if (s->nread < s->nsent && s->slept)
+    {
+        if (ioctl(s->slave, FIONREAD, &queued) < 0)
+            unix_error("ioctl error");
+        while (s->nread < s->nsent && s->end[s->nread] <= s->sent - queued)
+        {
+            s->t_read[s->nread] = now;
+            if (s->nread > 0)
+                settle(s, s->nread - 1, now, s->t_sent[s->nread]);
+            s->nread++;
+        }
+    }
+}
+
+/*
+ * settle - Line k was done at t, when the line after it (written at
+ *     t_next) was read. That's its latency if the next line was already
+ *     queued when the shell read line k, or came in while the shell was
+ *     still busy with it (it waited in the queue for more than a sample).
+ *     If both were read since the last sample, we can't tell.
+ */
+void settle(struct session_t *s, int k, double t, double t_next)
+{
+    if (s->ms[k] != -1)
+        return;
+    if (t == s->t_read[k])
+        s->ms[k] = -2;
+    else if (t_next <= s->t_read[k] || t - t_next > 2 * SAMPLEUS)
+        s->ms[k] = (t - s->t_read[k]) / 1e3;
+    else
+        s->ms[k] = -2; /* idle: not measured, and no longer pending */
+}
+
+/* kill_session - Kill every process left in session sid, using /proc */
+void kill_session(pid_t sid)
+{
+    DIR *dir;
+    struct dirent *de;
+    char path[300];
+    int pid, sess;
+    FILE *fp;
+
+    if ((dir = opendir("/proc")) == NULL)
+        unix_error("opendir error");
+    while ((de = readdir(dir)) != NULL)
+    {
+        if (!isdigit((unsigned char)de->d_name[0]))
+            continue;
+        snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        /* pid (comm) state ppid pgrp session -- comm may contain spaces */
+        if (fscanf(fp, "%d (%*[^)]) %*c %*d %*d %d", &pid, &sess) == 2 &&
+            sess == sid)
+            kill(pid, SIGKILL);
+        fclose(fp);
+    }
+    closedir(dir);
+}
+
+/*
+ * finish_trace - Compare the two outputs of a trace, check the limits
+ *     of its commands and report it. Returns 1 if it failed.
+ */
+int finish_trace(struct trace_t *t)
+{
+    struct result_t *res = t->run[0].res, *ref = t->run[1].res;
+    char *out, *refout, *diff = NULL, verdict[64], a[32], b[32];
+    double p50, max, rp50, rmax;
+    int n, rn, k, failed = 0, noref = 0;
+
+    rewind(t->run[0].out);
+    rewind(t->run[1].out);
+    out = read_all(t->run[0].out);
+    refout = read_all(t->run[1].out);
+
+    if (res->why[0])
+        failed = 1;
+    if (ref->why[0] || (WIFEXITED(ref->status) && WEXITSTATUS(ref->status) == 127))
+        noref = 1;
+    else if ((diff = compare(refout, out)) != NULL)
+        failed = 1;
+    for (k = 0; k < t->ncmds; k++)
+        if (t->cmds[k].limit && !(res->ms[k] >= 0 && res->ms[k] <= t->cmds[k].limit))
+            failed = 1;
+
+    snprintf(verdict, sizeof(verdict), "%s", failed ? "FAIL" : noref ? "no ref" : "pass");
+    printf("%-12s %-6s %5.1f s", t->name, verdict, res->secs);
+    if ((n = latencies(res, t->ncmds, &p50, &max)) > 0)
+        printf("  tsh p50 %7.2f ms max %8.2f ms (%d cmds)", p50, max, n);
+    if (!noref && (rn = latencies(ref, t->ncmds, &rp50, &rmax)) > 0)
+        printf("  ref p50 %7.2f ms max %8.2f ms", rp50, rmax);
+    printf("\n");
+
+    if (res->why[0])
+        printf("    tsh: %s\n", res->why);
+    if (noref)
+    {
+        refout[strcspn(refout, "\n")] = '\0'; /* say why with its first line */
+        printf("    ref: %s\n",
+               ref->why[0] ? ref->why : refout[0] ? refout : "can't run");
+    }
+    if (diff)
+        printf("    %s\n", diff);
+    for (k = 0; k < t->ncmds; k++)
+    {
+        if (t->cmds[k].limit && !(res->ms[k] >= 0 && res->ms[k] <= t->cmds[k].limit))
+        {
+            if (res->ms[k] >= 0)
+                printf("    EXPECT_WITHIN %d: %.2f ms for %s\n", t->cmds[k].limit,
+                       res->ms[k], t->cmds[k].line);
+            else
+                printf("    EXPECT_WITHIN %d: %s wasn't timed\n", t->cmds[k].limit,
+                       t->cmds[k].line);
+        }
+        else if (verbose)
+        {
+            printf("    tsh %s  ref %s  %s\n", fmt_ms(a, res->ms[k]),
+                   fmt_ms(b, noref ? -1 : ref->ms[k]), t->cmds[k].line);
+        }
+    }
+    fclose(t->run[0].out);
+    fclose(t->run[1].out);
+    free(out);
+    free(refout);
+    free(diff);
+    return failed;
+}
+
+/*
+ * compare - Compare the output of the shell with the reference's, line
+ *     by line, as checktsh.pl does: blank lines are skipped, the first
+ *     (PID) of a line is masked and spaces and tabs don't count. Lines
+ *     of ps output are skipped too. Returns NULL if they match, or a
+ *     malloc'ed description of the first difference.
+ */
+char *compare(char *ref, char *out)
+{
+    char *r, *o, *p = ref, *q = out, *diff;
+    int rps = 0, ops = 0, line = 0;
+    size_t size;
+
+    for (;;)
+    {
+        r = nextcmp(&p, &rps);
+        o = nextcmp(&q, &ops);
+        if (r == NULL && o == NULL)
+            return NULL;
+        line++;
+        if (r == NULL || o == NULL || strcmp(r, o))
+            break;
+    }
+    size = (r ? strlen(r) : 0) + (o ? strlen(o) : 0) + 64;
+    if ((diff = malloc(size)) == NULL)
+        unix_error("malloc error");
+    snprintf(diff, size, "output line %d: ref \"%s\", tsh \"%s\"", line,
+             r ? r : "(end)", o ? o : "(end)");
+    return diff;
+}
+
+/*
+ * nextcmp - The next line of *p to compare, normalized in place, or NULL
+ *     at the end; *inps is set while in ps output.
+ */
+char *nextcmp(char **p, int *inps)
+{
+    char *line;
+
+    while (**p)
+    {
+        line = *p;
+        *p += strcspn(line, "\n");
+        if (**p)
+            *(*p)++ = '\0';
+        if (!strncmp(line, "tsh>", 4))
+            *inps = strstr(line, "tsh> /bin/ps") != NULL;
+        else if (*inps)
+            continue;
+        normalize(line);
+        if (*line)
+            return line;
+    }
+    return NULL;
+}
+
+/* normalize - Drop CRs, spaces and tabs and mask the first (PID) */
+void normalize(char *line)
+{
+    char *p, *q, *pid = NULL;
+
+    for (p = q = line; *p; p++)
+    {
+        if (*p == '(' && !pid && isdigit((unsigned char)p[1]))
+        {
+            pid = p + 1;
+            while (isdigit((unsigned char)*pid))
+                pid++;
+            if (*pid == ')')
+            {
+                memcpy(q, "(PID)", 5);
+                q += 5;
+                p = pid;
+                continue;
+            }
+        }
+        if (*p != '\r' && *p != ' ' && *p != '\t')
+            *q++ = *p;
+    }
+    *q = '\0';
+}
+
+/* read_all - Read the rest of fp into a malloc'ed string */
+char *read_all(FILE *fp)
+{
+    size_t len = 0, cap = MAXLINE, n;
+    char *buf;
+
+    if ((buf = malloc(cap + 1)) == NULL)
+        unix_error("malloc error");
+    while ((n = fread(buf + len, 1, cap - len, fp)) > 0)
+    {
+        len += n;
+        if (len == cap && (buf = realloc(buf, (cap *= 2) + 1)) == NULL)
+            unix_error("realloc error");
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+/* fmt_ms - Format a latency, or "-" if there is none */
+char *fmt_ms(char *buf, double ms)
+{
+    if (ms >= 0)
+        sprintf(buf, "%8.2f ms", ms);
+    else
+        sprintf(buf, "%8s   ", "-");
+    return buf;
+}
+
+/* latencies - The p50 and max of the measured latencies of a run, and
+ *     how many there are */
+int latencies(struct result_t *res, int n, double *p50, double *max)
+{
+    double *ms;
+    int i, m = 0;
+
+    if ((ms = malloc((n + 1) * sizeof(double))) == NULL)
+        unix_error("malloc error");
+    for (i = 0; i < n; i++)
+        if (res->ms[i] >= 0)
+            ms[m++] = res->ms[i];
+    if (m > 0)
+    {
+        qsort(ms, m, sizeof(double), cmp_double);
+        *p50 = ms[m / 2];
+        *max = ms[m - 1];
+    }
+    free(ms);
+    return m;
+}
+
+/* now_us - Monotonic clock in microseconds */
+double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * usage - print a help message
+ */
+void usage(void)
+{
+    printf("Usage: tshdriver [-hv] [-s <shell>] [-r <refshell>] [-a <args>]\n"
+           "                 [-j <runs>] [-w <ms>] [-T <secs>] <trace>...\n");
+    printf("   -h            print this message\n");
+    printf("   -v            report the latency of every command\n");
+    printf("   -s <shell>    shell to test (default ./tsh)\n");
+    printf("   -r <refshell> reference shell (default ./tshref)\n");
+    printf("   -a <args>     arguments of both shells (default -p)\n");
+    printf("   -j <runs>     runs at a time (default 4 per CPU, at least 8)\n");
+    printf("   -w <ms>       how long WAITFOR waits (default 5000)\n");
+    printf("   -T <secs>     how long a run may take (default 25)\n");
+    exit(1);
+}
+
+/*
+ * unix_error - unix-style error routine
+ */
+void unix_error(char *msg)
+{
+    fprintf(stdout, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * app_error - application-style error routine
+ */
+void app_error(char *msg)
+{
+    fprintf(stdout, "%s\n", msg);
+    exit(1);
+}
@@ -0,0 +1,341 @@
+/*
+ * tshparse - Microbenchmark for the tiny shell's command line parser
+ *
+ * usage: tshparse [-h] [-n <megabytes>] [-v <vars>]
+ *
+ * Pulls in tsh.c (with its main renamed) and times parseline() on
+ * generated lines with more and more words, next to the parser it
+ * replaced. The old one copied the line twice (into eval's buffer and
+ * its own static one), rescanned it with strchr and strtok, and can't
+ * take more than MAXLINE bytes or OLDMAXARGS words, so it sits out the
+ * long lines. Each case parses about <megabytes> MB of text.
+ *
+ * Then, with <vars> variables in the environment, it times a line of
+ * $VAR words and the lookups and updates behind $VAR and export, in
+ * the shell's environment hash and with libc's getenv and setenv,
+ * which scan environ.
+ *
+ * Last, it times tracepoint(), the cost of one lifecycle event, with the
+ * trace on and off.
+ */
+#define main tsh_main
+#include "tsh.c"
+#undef main
+
+#define OLDMAXARGS 128 /* the old parser's argv size */
+#define ENVWORDS 100   /* $VAR words on the expansion line */
+
+struct case_t
+{
+    int words;   /* words on the line */
+    int wordlen; /* length of each word */
+};
+
+int oldparseline(const char *cmdline, char **argv);
+char *makeline(struct case_t *c);
+void benchenv(long megabytes, int nvars);
+void benchtrace(long megabytes);
+double now_ns(void);
+
+int main(int argc, char **argv)
+{
+    static struct case_t cases[] = {
+        {4, 6}, {16, 8}, {100, 8}, {1000, 8}, {10000, 8}, {100000, 8}};
+    struct arena_t arena = {NULL, 0, 0, 0};
+    struct words_t words;
+    char *oldargv[OLDMAXARGS], buf[MAXLINE], *line;
+    double t0, t_new, t_old;
+    long iters, i, megabytes = 64;
+    size_t len;
+    int k, c, nvars = 500;
+
+    while ((c = getopt(argc, argv, "hn:v:")) != EOF)
+    {
+        switch (c)
+        {
+        case 'n':
+            megabytes = atol(optarg);
+            break;
+        case 'v':
+            nvars = atoi(optarg);
+            break;
+        default:
+            printf("Usage: tshparse [-h] [-n <megabytes>] [-v <vars>]\n");
+            exit(1);
+        }
+    }
+
+    setenv("TSHPARSE", "value", 1);
+    initenv(&shellenv, environ);
+    for (k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++)
+    {
+        line = makeline(&cases[k]);
+        len = strlen(line);
+        iters = (megabytes << 20) / len + 1;
+
+        t0 = now_ns();
+        for (i = 0; i < iters; i++)
+        {
+            arenareset(&arena);
+            parseline(line, &arena, &words);
+        }
+        t_new = (now_ns() - t0) / iters;
+        if (words.argc != cases[k].words)
+            app_error("FAIL: parseline found the wrong number of words");
+
+        printf("%6d words, %7zu bytes: new %9.0f ns/line (%5.0f MB/s)",
+               cases[k].words, len, t_new, len / t_new * 1e3);
+        if (len < MAXLINE && cases[k].words < OLDMAXARGS)
+        {
+            t0 = now_ns();
+            for (i = 0; i < iters; i++)
+            {
+                strcpy(buf, line); /* as eval did */
+                oldparseline(buf, oldargv);
+            }
+            t_old = (now_ns() - t0) / iters;
+            printf(", old %7.0f ns/line (%5.0f MB/s)", t_old, len / t_old * 1e3);
+        }
+        else
+        {
+            printf(", old: too long");
+        }
+        printf("\n");
+        free(line);
+    }
+    benchenv(megabytes, nvars);
+    benchtrace(megabytes);
+    exit(0);
+}
+
+/*
+ * benchenv - Add nvars variables to the environment, then time a line
+ *     of ENVWORDS $VAR words (each parser with its own lookup), one
+ *     lookup and one export, each against the libc functions.
+ */
+void benchenv(long megabytes, int nvars)
+{
+    struct arena_t arena = {NULL, 0, 0, 0};
+    struct words_t words;
+    char name[32], value[32], *line, *p;
+    double t0, t_hash, t_libc;
+    long iters, i;
+    int k;
+
+    for (k = 0; k < nvars; k++)
+    {
+        snprintf(name, sizeof(name), "TSHVAR%d", k);
+        snprintf(value, sizeof(value), "value%d", k);
+        setenv(name, value, 1);
+        setenvvar(&shellenv, name, strlen(name), value);
+    }
+
+    /* a line of $VAR words spread over the environment */
+    if ((line = malloc(ENVWORDS * 16 + 2)) == NULL)
+        unix_error("malloc error");
+    for (k = 0, p = line; k < ENVWORDS; k++)
+        p += sprintf(p, "$TSHVAR%d ", (int)((long)k * nvars / ENVWORDS));
+    strcpy(p - 1, "\n");
+    iters = (megabytes << 20) / strlen(line) / 8 + 1;
+
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+    {
+        arenareset(&arena);
+        parseline(line, &arena, &words);
+    }
+    t_hash = (now_ns() - t0) / iters;
+    if (words.argc != ENVWORDS)
+        app_error("FAIL: parseline lost a $VAR");
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+    { /* what each $VAR cost when parseline called getenv */
+        for (p = line; (p = strchr(p, '$')) != NULL; p++)
+        {
+            memcpy(name, p + 1, strcspn(p + 1, " \n"));
+            name[strcspn(p + 1, " \n")] = '\0';
+            if (getenv(name) == NULL)
+                app_error("FAIL: getenv lost a $VAR");
+        }
+    }
+    t_libc = (now_ns() - t0) / iters;
+    printf("%d vars: line of %d $VARs: hash %7.0f ns/line, getenv lookups alone %7.0f ns/line\n",
+           nvars, ENVWORDS, t_hash, t_libc);
+
+    iters *= ENVWORDS;
+    snprintf(name, sizeof(name), "TSHVAR%d", nvars - 1);
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+        if (getenvvar(&shellenv, name) == NULL)
+            app_error("FAIL: getenvvar lost a variable");
+    t_hash = (now_ns() - t0) / iters;
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+        if (getenv(name) == NULL)
+            app_error("FAIL: getenv lost a variable");
+    t_libc = (now_ns() - t0) / iters;
+    printf("%d vars: lookup: hash %5.0f ns, getenv %5.0f ns\n", nvars, t_hash,
+           t_libc);
+
+    iters /= 10;
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+        setenvvar(&shellenv, name, strlen(name), i & 1 ? "odd" : "even");
+    t_hash = (now_ns() - t0) / iters;
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+        setenv(name, i & 1 ? "odd" : "even", 1);
+    t_libc = (now_ns() - t0) / iters;
+    printf("%d vars: export: hash %5.0f ns, setenv %5.0f ns\n", nvars, t_hash,
+           t_libc);
+    free(line);
+}
+
+/*
+ * benchtrace - Time tracepoint() on and off, megabytes << 16 times. On,
+ *     it goes around the ring many times, as a long trace would.
+ */
+void benchtrace(long megabytes)
+{
+    long iters = megabytes << 16, i;
+    double t0, t_on, t_off;
+
+    inittrace();
+    tring->on = 1;
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+        tracepoint(TR_REAP, (pid_t)i, 1, 0);
+    t_on = (now_ns() - t0) / iters;
+    if (tring->head != (uint64_t)iters)
+        app_error("FAIL: the trace ring lost events");
+    tring->on = 0;
+    t0 = now_ns();
+    for (i = 0; i < iters; i++)
+        tracepoint(TR_REAP, (pid_t)i, 1, 0);
+    t_off = (now_ns() - t0) / iters;
+    printf("tracepoint: on %5.1f ns/event, off %5.1f ns\n", t_on, t_off);
+}
+
+/*
+ * makeline - Generate a command line of c->words words: plain words, a
+ *     quoted word with a space in it every 16 words, and a $VAR at the
+ *     end (the old parser copied everything after a $ into a 100-byte
+ *     buffer, so it can't have one earlier on a long line).
+ */
+char *makeline(struct case_t *c)
+{
+    char *line, *p;
+    int i, j;
+
+    if ((line = malloc((size_t)c->words * (c->wordlen + 3) + 2)) == NULL)
+        unix_error("malloc error");
+    for (i = 0, p = line; i < c->words; i++)
+    {
+        if (i % 16 == 5)
+        {
+            p += sprintf(p, "'%.*s %.*s' ", c->wordlen / 2 - 1, "abcdefgh",
+                         c->wordlen / 2, "abcdefgh");
+        }
+        else if (i == c->words - 1)
+        {
+            p += sprintf(p, "$TSHPARSE ");
+        }
+        else
+        {
+            for (j = 0; j < c->wordlen; j++)
+                *p++ = 'a' + (i + j) % 26;
+            *p++ = ' ';
+        }
+    }
+    strcpy(p - 1, "\n");
+    return line;
+}
+
+/*
+ * oldparseline - The parser tsh had before, kept as the baseline.
+ */
+int oldparseline(const char *cmdline, char **argv)
+{
+    static char array[MAXLINE]; /* holds local copy of command line */
+    char *buf = array;          /* ptr that traverses command line */
+    char *delim;                /* points to first space delimiter */
+    int argc;                   /* number of args */
+    int bg;                     /* background job? */
+
+    strcpy(buf, cmdline);
+    buf[strlen(buf) - 1] = ' ';   /* replace trailing '\n' with space */
+    while (*buf && (*buf == ' ')) /* ignore leading spaces */
+        buf++;
+
+    /* Build the argv list */
+    argc = 0;
+    if (*buf == '\'')
+    {
+        buf++;
+        delim = strchr(buf, '\'');
+    }
+    else
+    {
+        delim = strchr(buf, ' ');
+    }
+
+    while (delim)
+    {
+        if (*buf == '$')
+        {
+            buf++;
+            static char arr[100];
+            char *ptr = arr;
+            strcpy(ptr, buf);       /*copy to temporary var*/
+            ptr = strtok(ptr, " "); /*remove empty spaces*/
+            if (getenv(ptr))
+            { /*check if registered env variable*/
+                buf = strtok(buf, " ");
+                buf = getenv(buf); /* if valid replace the variable name with its value*/
+            }
+            else
+            {
+                buf += (strlen(ptr) + 1); /*else check next one*/
+                argv[argc] = buf;
+            }
+        }
+        else
+        {
+            argv[argc++] = buf;
+            *delim = '\0';
+            buf = delim + 1;
+            while (*buf && (*buf == ' ')) /* ignore spaces */
+                buf++;
+            if (*buf == '\'')
+            {
+                buf++;
+                delim = strchr(buf, '\'');
+            }
+            else
+            {
+                delim = strchr(buf, ' ');
+            }
+        }
+    }
+
+    argv[argc] = NULL;
+
+    if (argc == 0) /* ignore blank line */
+        return 1;
+
+    /* should the job run in the background? */
+    if ((bg = (*argv[argc - 1] == '&')) != 0)
+    {
+        argv[--argc] = NULL;
+    }
+    return bg;
+}
+
+/* now_ns - Monotonic clock in nanoseconds */
+double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
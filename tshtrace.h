@@ -0,0 +1,35 @@
+/*
+ * tshtrace.h - What tsh and tshbench share: the events of tsh's
+ * lifecycle trace, as "trace dump -b" writes them, and the size of the
+ * output ring of a captured job.
+ */
+#ifndef TSHTRACE_H
+#define TSHTRACE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define CAPTURECAP 65536 /* output kept per captured job (a power of 2) */
+
+#define TR_PARSE 0   /* eval() has parsed a line; arg: its words */
+#define TR_FORK 1    /* launch() started making a child */
+#define TR_EXEC 2    /* the child is about to exec (with -s: has exec'd) */
+#define TR_SIGRECV 3 /* a signal reached the shell; arg: the signal */
+#define TR_SIGNAL 4  /* the shell sent a signal to a job; arg: the signal */
+#define TR_CONT 5    /* the shell sent SIGCONT to a job */
+#define TR_STOP 6    /* a child stopped; arg: the signal */
+#define TR_REAP 7    /* a child was reaped; arg: its wait status */
+#define TR_FGDONE 8  /* waitfg() returned */
+#define TR_TYPES 9
+
+struct trevent_t
+{
+    uint64_t t;   /* timestamp, in tracetime() ticks */
+    uint64_t seq; /* event number + 1 once written, 0 while it is */
+    pid_t pid;    /* the process it is about, 0 for the shell */
+    int jid;      /* its job, 0 if not known (yet) */
+    int arg;      /* see the types */
+    int type;     /* TR_* */
+};
+
+#endif /* TSHTRACE_H */